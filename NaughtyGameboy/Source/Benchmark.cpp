@@ -0,0 +1,265 @@
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "Benchmark.h"
+#include "FrameHash.h"
+#include "Gameboy.h"
+#include "Logger.h"
+#include "PixelKernels.h"
+#include "PPURegisters.h"
+#include "Scalers.h"
+
+typedef std::chrono::high_resolution_clock Clock;
+
+/** Run function iterations times and return the nanoseconds per iteration */
+template<typename TFunction>
+static double MeasureNanoseconds(int iterations, TFunction function)
+{
+	Clock::time_point start = Clock::now();
+	for (int i = 0; i < iterations; i++)
+	{
+		function();
+	}
+
+	std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+	return elapsed.count() / iterations;
+}
+
+void Benchmark::RunPixelKernels()
+{
+	const int TileCount = 384;
+	const int TileSize = 16;
+	const int LineWidth = 160;
+	const int Iterations = 20000;
+
+	std::mt19937 random(1234);
+	std::vector<byte> tileData(TileCount * TileSize);
+	for (byte& value : tileData)
+	{
+		value = (byte)random();
+	}
+
+	// A DMG palette (BGP, OBP0, OBP1) and a CGB palette (8 background and 8 sprite palettes)
+	const int PaletteSizes[] = { 12, 64 };
+	uint palette[64];
+	for (uint& color : palette)
+	{
+		color = 0xFF000000 | (uint)random();
+	}
+
+	std::vector<std::vector<byte>> lines(ARRAY_SIZE(PaletteSizes), std::vector<byte>(LineWidth));
+	for (int i = 0; i < ARRAY_SIZE(PaletteSizes); i++)
+	{
+		for (byte& index : lines[i])
+		{
+			index = (byte)(random() % PaletteSizes[i]);
+		}
+	}
+
+	// The layers of a line. About half of the sprite pixels are transparent
+	byte backgroundLine[LineWidth];
+	byte spriteLine[LineWidth];
+	byte spriteFlags[LineWidth];
+	for (int x = 0; x < LineWidth; x++)
+	{
+		backgroundLine[x] = (byte)(random() % 4);
+		spriteLine[x] = (random() % 2 == 0) ? 0 : (byte)(random() % 4);
+		spriteFlags[x] = (byte)random();
+	}
+
+	const PixelKernels& scalar = *PixelKernels::Get(PixelKernelSet::Scalar);
+	std::vector<byte> referenceIndices(TileCount * 64);
+	scalar.decodeTileRows(tileData.data(), referenceIndices.data(), TileCount * 8);
+
+	byte referenceColors[LineWidth];
+	scalar.composeLine(backgroundLine, spriteLine, spriteFlags, referenceColors, LineWidth);
+
+	double scalarDecode = 0.0;
+	double scalarCompose = 0.0;
+	double scalarMap[ARRAY_SIZE(PaletteSizes)] = {};
+
+	for (int set = 0; set < (int)PixelKernelSet::Count; set++)
+	{
+		const PixelKernels* kernels = PixelKernels::Get((PixelKernelSet)set);
+		if (kernels == nullptr)
+		{
+			Logger::Log("Kernel set %d is not supported", set);
+			continue;
+		}
+
+		// Tile decode, 1 tile (8 rows) per call like the tile cache
+		std::vector<byte> indices(TileCount * 64);
+		double decode = MeasureNanoseconds(Iterations / 10, [&]()
+		{
+			for (int tile = 0; tile < TileCount; tile++)
+			{
+				kernels->decodeTileRows(&tileData[tile * TileSize], &indices[tile * 64], 8);
+			}
+		}) / TileCount;
+
+		if (set == (int)PixelKernelSet::Scalar)
+		{
+			scalarDecode = decode;
+		}
+
+		bool isDecodeCorrect = (indices == referenceIndices);
+		Logger::Log("%-6s decode tile:   %7.2f ns (%.2fx)%s", kernels->name, decode, scalarDecode / decode, isDecodeCorrect ? "" : " MISMATCH");
+
+		// Compositing of a whole line
+		byte colors[LineWidth];
+		double compose = MeasureNanoseconds(Iterations, [&]()
+		{
+			kernels->composeLine(backgroundLine, spriteLine, spriteFlags, colors, LineWidth);
+		});
+
+		if (set == (int)PixelKernelSet::Scalar)
+		{
+			scalarCompose = compose;
+		}
+
+		bool isComposeCorrect = (std::memcmp(colors, referenceColors, sizeof(colors)) == 0);
+		Logger::Log("%-6s compose line:  %7.2f ns (%.2fx)%s", kernels->name, compose, scalarCompose / compose, isComposeCorrect ? "" : " MISMATCH");
+
+		// Palette mapping of a whole line
+		for (int i = 0; i < ARRAY_SIZE(PaletteSizes); i++)
+		{
+			uint pixels[LineWidth];
+			uint referencePixels[LineWidth];
+			scalar.mapPalette(lines[i].data(), palette, PaletteSizes[i], referencePixels, LineWidth);
+
+			double map = MeasureNanoseconds(Iterations, [&]()
+			{
+				kernels->mapPalette(lines[i].data(), palette, PaletteSizes[i], pixels, LineWidth);
+			});
+
+			if (set == (int)PixelKernelSet::Scalar)
+			{
+				scalarMap[i] = map;
+			}
+
+			bool isMapCorrect = (std::memcmp(pixels, referencePixels, sizeof(pixels)) == 0);
+			Logger::Log("%-6s map line (%2d):  %7.2f ns (%.2fx)%s", kernels->name, PaletteSizes[i], map, scalarMap[i] / map, isMapCorrect ? "" : " MISMATCH");
+		}
+	}
+}
+
+void Benchmark::RunScalers()
+{
+	const int Iterations = 200;
+
+	// DMG shades in runs, so the frame has edges for the smoothing filters to find, like a real picture
+	const uint Shades[] = { 0xFFFFFFFF, 0xFFAAAAAA, 0xFF555555, 0xFF000000 };
+	std::mt19937 random(1234);
+	std::vector<uint> frame(LCDWidth * LCDHeight);
+	for (int i = 0; i < (int)frame.size(); )
+	{
+		uint shade = Shades[random() % 4];
+		for (int run = 1 + random() % 6; run > 0 && i < (int)frame.size(); run--)
+		{
+			frame[i++] = shade;
+		}
+	}
+
+	for (int filter = (int)ScaleFilter::Nearest2x; filter < (int)ScaleFilter::Count; filter++)
+	{
+		int factor = Scalers::GetFactor((ScaleFilter)filter);
+		std::vector<uint> reference(LCDWidth * LCDHeight * factor * factor);
+		std::vector<uint> output(reference.size());
+
+		double scalar = MeasureNanoseconds(Iterations, [&]()
+		{
+			Scalers::ScaleReference((ScaleFilter)filter, frame.data(), reference.data());
+		});
+
+		double simd = MeasureNanoseconds(Iterations, [&]()
+		{
+			Scalers::Scale((ScaleFilter)filter, frame.data(), output.data());
+		});
+
+		bool isCorrect = (output == reference);
+		Logger::Log("%-10s scalar: %9.0f ns/frame, SIMD: %9.0f ns/frame (%.2fx)%s",
+			Scalers::GetName((ScaleFilter)filter), scalar, simd, scalar / simd, isCorrect ? "" : " MISMATCH");
+	}
+}
+
+void Benchmark::RunFrameHash()
+{
+	const int Iterations = 2000;
+	const int EmulatedFrames = 300;
+
+	std::mt19937 random(1234);
+
+	// The emulation of a frame, drawn and without any other work, is what the hash is compared to.
+	// There is no cartridge, so the background and sprites are seeded while the LCD is off, and the LCD is turned on after
+	Gameboy gameboy;
+	MMU* mmu = gameboy.GetMMU();
+	for (int address = 0x8000; address < 0xA000; address++)
+	{
+		mmu->WriteByte((ushort)address, (byte)random());
+	}
+
+	for (int address = 0xFE00; address < 0xFEA0; address++)
+	{
+		mmu->WriteByte((ushort)address, (byte)random());
+	}
+
+	// The CPU runs through the empty ROM and then spins on a JR -2 at the start of VRAM, so it never executes the random tiles
+	mmu->WriteByte(0x8000, 0x18);
+	mmu->WriteByte(0x8001, 0xFE);
+
+	mmu->WriteByte(IO::BGP, 0xE4);
+	mmu->WriteByte(IO::OBP0, 0xD2);
+	mmu->WriteByte(IO::OBP1, 0x1B);
+	mmu->WriteByte(IO::LCDC, 0x93); // LCD, background and sprites on, tile data at 0x8000
+
+	Clock::time_point start = Clock::now();
+	ulong frameCount = gameboy.GetPPU()->GetFrameCount();
+	for (ulong cycles = 0; cycles < 70224 * EmulatedFrames && gameboy.GetPPU()->GetFrameCount() < frameCount + EmulatedFrames; )
+	{
+		cycles += gameboy.Step();
+	}
+
+	std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+	double frameTime = elapsed.count() / EmulatedFrames;
+	Logger::Log("Emulated frame: %.0f ns", frameTime);
+
+	std::vector<byte> frame(LCDWidth * LCDHeight * sizeof(uint));
+	for (byte& value : frame)
+	{
+		value = (byte)random();
+	}
+
+	// Headless hash logs are over the shade numbers (Index8), runs with a window over ARGB8888
+	const PixelFormat Formats[] = { PixelFormat::Index8, PixelFormat::ARGB8888 };
+	const char* const FormatNames[] = { "Index8", "ARGB8888" };
+	for (int i = 0; i < ARRAY_SIZE(Formats); i++)
+	{
+		size_t size = PixelFormats::GetLineSize(Formats[i]) * LCDHeight;
+		ulonglong referenceHash = FrameHash::Compute(frame.data(), size, PixelKernelSet::Scalar);
+		double scalar = 0.0;
+
+		for (int set = 0; set < (int)PixelKernelSet::Count; set++)
+		{
+			const PixelKernels* kernels = PixelKernels::Get((PixelKernelSet)set);
+			if (kernels == nullptr)
+			{
+				continue;
+			}
+
+			ulonglong hash = 0;
+			double time = MeasureNanoseconds(Iterations, [&]()
+			{
+				hash = FrameHash::Compute(frame.data(), size, (PixelKernelSet)set);
+			});
+
+			if (set == (int)PixelKernelSet::Scalar)
+			{
+				scalar = time;
+			}
+
+			Logger::Log("%-6s hash %-8s %7.0f ns (%.2fx), %.3f%% of a frame%s", kernels->name, FormatNames[i], time, scalar / time,
+				time * 100.0 / frameTime, (hash == referenceHash) ? "" : " MISMATCH");
+		}
+	}
+}
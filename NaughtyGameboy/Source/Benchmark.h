@@ -0,0 +1,16 @@
+#pragma once
+
+#include "PCH.h"
+
+/** Micro benchmarks of the hot paths. Run from the command line and log their results */
+namespace Benchmark
+{
+	/** Compare the SIMD pixel kernels to the scalar reference. Also checks that they produce the same output */
+	void RunPixelKernels();
+
+	/** Time every scale filter per frame, SIMD against the scalar reference, and check that their outputs match */
+	void RunScalers();
+
+	/** Time the frame hash, SIMD against the scalar reference, and compare it to the time the emulation of a frame takes */
+	void RunFrameHash();
+}
@@ -0,0 +1,45 @@
+#include "CGBColors.h"
+
+static std::unique_ptr<uint[]> BuildTable(bool isColorCorrected)
+{
+	std::unique_ptr<uint[]> table(new uint[CGBColors::ColorCount]);
+	for (int color = 0; color < CGBColors::ColorCount; color++)
+	{
+		table[color] = CGBColors::Convert((ushort)color, isColorCorrected);
+	}
+
+	return table;
+}
+
+const uint* CGBColors::GetTable(bool isColorCorrected)
+{
+	// 128 KB each. Built once per process, the initialization of the statics is thread safe
+	static const std::unique_ptr<uint[]> rawTable = BuildTable(false);
+	static const std::unique_ptr<uint[]> correctedTable = BuildTable(true);
+
+	return isColorCorrected ? correctedTable.get() : rawTable.get();
+}
+
+uint CGBColors::Convert(ushort color, bool isColorCorrected)
+{
+	uint red = color & 0x1F;
+	uint green = (color >> 5) & 0x1F;
+	uint blue = (color >> 10) & 0x1F;
+
+	if (isColorCorrected)
+	{
+		// The channels bleed into each other on the CGB screen, and it never gets fully bright. Each sum is at most 248
+		uint correctedRed = (red * 13 + green * 2 + blue) >> 1;
+		uint correctedGreen = (green * 3 + blue) << 1;
+		uint correctedBlue = (red * 3 + green * 2 + blue * 11) >> 1;
+
+		return 0xFF000000 | (correctedRed << 16) | (correctedGreen << 8) | correctedBlue;
+	}
+
+	// Repeat the top bits in the low bits, so 31 becomes 255
+	red = (red << 3) | (red >> 2);
+	green = (green << 3) | (green >> 2);
+	blue = (blue << 3) | (blue >> 2);
+
+	return 0xFF000000 | (red << 16) | (green << 8) | blue;
+}
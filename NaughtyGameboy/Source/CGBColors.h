@@ -0,0 +1,22 @@
+#pragma once
+
+#include "PCH.h"
+
+/**
+* The conversion of the 15 bit CGB colors (5 bits each, red in the low bits) to ARGB8888.
+* Every color goes through a lookup table of all 32768 colors that is shared by all instances,
+* so the output of a color is a single load.
+*/
+namespace CGBColors
+{
+	const int ColorCount = 0x8000;
+
+	/**
+	* The table for all the colors. The color corrected one mixes the channels and darkens them like the CGB screen does,
+	* the other only scales the channels to 8 bits. Built on the first call
+	*/
+	const uint* GetTable(bool isColorCorrected);
+
+	/** Convert one color without the table. This is what the tables are built from */
+	uint Convert(ushort color, bool isColorCorrected);
+}
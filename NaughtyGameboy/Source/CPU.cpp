@@ -1,6 +1,8 @@
 #include "CPU.h"
 #include "Logger.h"
 #include "BitUtil.h"
+#include "IORegisters.h"
+#include "StateArena.h"
 
 const byte CPU::ZeroFlag = 7;
 const byte CPU::SubtractFlag = 6;
@@ -13,17 +15,12 @@ const byte CPU::HalfCarryFlagMask = 1 << 5;
 const byte CPU::CarryFlagMask = 1 << 4;
 const byte CPU::AllFlagsMask = 0xF0;
 
-CPU::CPU() :
-	m_cycles(0),
-	m_isHalted(false),
-	m_IME(0),
-	m_AF(0x0000),
-	m_BC(0x0000),
-	m_DE(0x0000),
-	m_HL(0x0000),
-	m_SP(0x0000),
-	m_PC(0x0000)
+CPU::CPU(MMU* mmu, StateArena* arena) :
+	m_state(arena->Allocate<State>()),
+	m_MMU(mmu)
 {
+	// The arena memory is zeroed, so all the registers start at 0x0000
+
 	// In binary ##dddsss, where ddd is the DST register, and sss is the SRC register
 	// -------
 	// B = 000
@@ -34,14 +31,14 @@ CPU::CPU() :
 	// L = 101
 	// F = 110 - unused
 	// A = 111
-	m_byteRegisterMap[0x00] = reinterpret_cast<byte*>(&m_BC) + 1; // Because the Z80 CPU is low-endian, a 16bit address 0x[B][C] in the memory is [C][B]. The low byte comes first
-	m_byteRegisterMap[0x01] = reinterpret_cast<byte*>(&m_BC);
-	m_byteRegisterMap[0x02] = reinterpret_cast<byte*>(&m_DE) + 1;
-	m_byteRegisterMap[0x03] = reinterpret_cast<byte*>(&m_DE);
-	m_byteRegisterMap[0x04] = reinterpret_cast<byte*>(&m_HL) + 1;
-	m_byteRegisterMap[0x05] = reinterpret_cast<byte*>(&m_HL);
-	m_byteRegisterMap[0x06] = reinterpret_cast<byte*>(&m_AF); // Should not be used (F)
-	m_byteRegisterMap[0x07] = reinterpret_cast<byte*>(&m_AF) + 1;
+	m_byteRegisterMap[0x00] = reinterpret_cast<byte*>(&m_state->BC) + 1; // Because the Z80 CPU is low-endian, a 16bit address 0x[B][C] in the memory is [C][B]. The low byte comes first
+	m_byteRegisterMap[0x01] = reinterpret_cast<byte*>(&m_state->BC);
+	m_byteRegisterMap[0x02] = reinterpret_cast<byte*>(&m_state->DE) + 1;
+	m_byteRegisterMap[0x03] = reinterpret_cast<byte*>(&m_state->DE);
+	m_byteRegisterMap[0x04] = reinterpret_cast<byte*>(&m_state->HL) + 1;
+	m_byteRegisterMap[0x05] = reinterpret_cast<byte*>(&m_state->HL);
+	m_byteRegisterMap[0x06] = reinterpret_cast<byte*>(&m_state->AF); // Should not be used (F)
+	m_byteRegisterMap[0x07] = reinterpret_cast<byte*>(&m_state->AF) + 1;
 
 	// In binary ##rr####, where rr is a 16bit register
 	// -------
@@ -49,27 +46,29 @@ CPU::CPU() :
 	// 01 = DE
 	// 10 = HL
 	// 11 = SP
-	m_ushortRegisterMap[0x00] = &m_BC;
-	m_ushortRegisterMap[0x01] = &m_DE;
-	m_ushortRegisterMap[0x02] = &m_HL;
-	m_ushortRegisterMap[0x03] = &m_SP;
-
-	m_MMU = std::make_unique<MMU>();
+	m_ushortRegisterMap[0x00] = &m_state->BC;
+	m_ushortRegisterMap[0x01] = &m_state->DE;
+	m_ushortRegisterMap[0x02] = &m_state->HL;
+	m_ushortRegisterMap[0x03] = &m_state->SP;
 
 	InitInstructionMap();
 }
 
 ulong CPU::Step()
 {
-	ulong cycles = 0;
+	ulong cycles = HandleInterrupts();
+	if (cycles > 0)
+	{
+		return cycles;
+	}
 
-	if (m_isHalted)
+	if (m_state->isHalted)
 	{
 		cycles = NOP(0x00);
 	}
 	else
 	{
-		ushort address = m_PC;
+		ushort address = m_state->PC;
 		byte opcode = ReadBytePCI();
 		InstructionFunction instruction = nullptr;
 
@@ -96,18 +95,53 @@ ulong CPU::Step()
 	return cycles;
 }
 
+ulong CPU::HandleInterrupts()
+{
+	byte pending = m_MMU->GetIORegister(IO::IE) & m_MMU->GetIORegister(IO::IF) & 0x1F;
+	if (pending == 0)
+	{
+		return 0;
+	}
+
+	// A pending interrupt ends the HALT even if the interrupts are disabled
+	m_state->isHalted = false;
+
+	if (m_state->IME == 0)
+	{
+		return 0;
+	}
+
+	for (byte interrupt = 0; interrupt < 5; interrupt++)
+	{
+		if (IS_BIT_SET(pending, interrupt))
+		{
+			m_state->IME = 0;
+			byte flags = m_MMU->GetIORegister(IO::IF);
+			m_MMU->SetIORegister(IO::IF, CLEAR_BIT(flags, interrupt));
+
+			// The interrupt vectors are 0x40, 0x48, 0x50, 0x58 and 0x60
+			PushUShortToStack(m_state->PC);
+			m_state->PC = 0x40 + interrupt * 8;
+
+			return 20;
+		}
+	}
+
+	return 0;
+}
+
 byte CPU::ReadBytePCI()
 {
-	byte value = m_MMU->ReadByte(m_PC);
-	m_PC++;
+	byte value = m_MMU->ReadByte(m_state->PC);
+	m_state->PC++;
 
 	return value;
 }
 
 ushort CPU::ReadUShortPCI()
 {
-	ushort value = m_MMU->ReadUShort(m_PC);
-	m_PC += 2;
+	ushort value = m_MMU->ReadUShort(m_state->PC);
+	m_state->PC += 2;
 
 	return value;
 }
@@ -715,24 +749,24 @@ void CPU::PushByteToStack(byte value)
 {
 	// The stack is in range FF80-FFFE where FFFE is the bottom of the stack, and FF80 is the maximum top of the stack
 	// So in order to push something to the stack we need to decrement the stack pointer first
-	m_SP--;
-	m_MMU->WriteByte(m_SP, value);
+	m_state->SP--;
+	m_MMU->WriteByte(m_state->SP, value);
 }
 
 void CPU::PushUShortToStack(ushort value)
 {
 	// The stack is in range FF80-FFFE where FFFE is the bottom of the stack, and FF80 is the maximum top of the stack
 	// So in order to push something to the stack we need to decrement the stack pointer first
-	m_SP -= 2;
-	m_MMU->WriteUShort(m_SP, value);
+	m_state->SP -= 2;
+	m_MMU->WriteUShort(m_state->SP, value);
 }
 
 byte CPU::PopByteFromStack()
 {
 	// The stack is in range FF80-FFFE where FFFE is the bottom of the stack, and FF80 is the maximum top of the stack
 	// So in order to pop something from the stack we need to increase the stack pointer after we read the data from it
-	byte value = m_MMU->ReadByte(m_SP);
-	m_SP++;
+	byte value = m_MMU->ReadByte(m_state->SP);
+	m_state->SP++;
 
 	return value;
 }
@@ -741,35 +775,35 @@ ushort CPU::PopUShortFromStack()
 {
 	// The stack is in range FF80-FFFE where FFFE is the bottom of the stack, and FF80 is the maximum top of the stack
 	// So in order to pop something from the stack we need to increase the stack pointer after we read the data from it
-	ushort value = m_MMU->ReadUShort(m_SP);
-	m_SP += 2;
+	ushort value = m_MMU->ReadUShort(m_state->SP);
+	m_state->SP += 2;
 
 	return value;
 }
 
 byte CPU::GetFlag(byte flag)
 {
-	byte F = GetLowByte(m_AF);
+	byte F = GetLowByte(m_state->AF);
 	return GET_BIT(F, flag);
 }
 
 void CPU::SetFlag(byte flag)
 {
-	byte F = GetLowByte(m_AF);
+	byte F = GetLowByte(m_state->AF);
 	F = SET_BIT(F, flag);
-	SetLowByte(&m_AF, F);
+	SetLowByte(&m_state->AF, F);
 }
 
 void CPU::ClearFlag(byte flag)
 {
-	byte F = GetLowByte(m_AF);
+	byte F = GetLowByte(m_state->AF);
 	F = CLEAR_BIT(F, flag);
-	SetLowByte(&m_AF, F);
+	SetLowByte(&m_state->AF, F);
 }
 
 bool CPU::IsFlagSet(byte flag)
 {
-	byte F = GetLowByte(m_AF);
+	byte F = GetLowByte(m_state->AF);
 	return IS_BIT_SET(F, flag);
 }
 
@@ -1098,7 +1132,7 @@ ulong CPU::LD_r_R(byte opcode)
 
 ulong CPU::LD_r_0xHL(byte opcode)
 {
-	byte value = m_MMU->ReadByte(m_HL);
+	byte value = m_MMU->ReadByte(m_state->HL);
 	byte* r = GetByteRegister_Dst(opcode);
 	*r = value;
 
@@ -1108,7 +1142,7 @@ ulong CPU::LD_r_0xHL(byte opcode)
 ulong CPU::LD_0xHL_r(byte opcode)
 {
 	byte* r = GetByteRegister_Src(opcode);
-	m_MMU->WriteByte(m_HL, *r);
+	m_MMU->WriteByte(m_state->HL, *r);
 
 	return 8;
 }
@@ -1116,23 +1150,23 @@ ulong CPU::LD_0xHL_r(byte opcode)
 ulong CPU::LD_0xHL_n(byte opcode)
 {
 	byte n = ReadBytePCI();
-	m_MMU->WriteByte(m_HL, n);
+	m_MMU->WriteByte(m_state->HL, n);
 
 	return 12;
 }
 
 ulong CPU::LD_A_0xBC(byte opcode)
 {
-	byte value = m_MMU->ReadByte(m_BC);
-	SetHighByte(&m_AF, value);
+	byte value = m_MMU->ReadByte(m_state->BC);
+	SetHighByte(&m_state->AF, value);
 
 	return 8;
 }
 
 ulong CPU::LD_A_0xDE(byte opcode)
 {
-	byte value = m_MMU->ReadByte(m_DE);
-	SetHighByte(&m_AF, value);
+	byte value = m_MMU->ReadByte(m_state->DE);
+	SetHighByte(&m_state->AF, value);
 
 	return 8;
 }
@@ -1141,30 +1175,30 @@ ulong CPU::LD_A_0xnn(byte opcode)
 {
 	ushort nn = ReadUShortPCI();
 	byte value = m_MMU->ReadByte(nn);
-	SetHighByte(&m_AF, value);
+	SetHighByte(&m_state->AF, value);
 
 	return 16;
 }
 
 ulong CPU::LD_0xBC_A(byte opcode)
 {
-	byte A = GetHighByte(m_AF);
-	m_MMU->WriteByte(m_BC, A);
+	byte A = GetHighByte(m_state->AF);
+	m_MMU->WriteByte(m_state->BC, A);
 
 	return 8;
 }
 
 ulong CPU::LD_0xDE_A(byte opcode)
 {
-	byte A = GetHighByte(m_AF);
-	m_MMU->WriteByte(m_DE, A);
+	byte A = GetHighByte(m_state->AF);
+	m_MMU->WriteByte(m_state->DE, A);
 
 	return 8;
 }
 
 ulong CPU::LD_0xnn_A(byte opcode)
 {
-	byte A = GetHighByte(m_AF);
+	byte A = GetHighByte(m_state->AF);
 	ushort nn = ReadUShortPCI();
 	m_MMU->WriteByte(nn, A);
 
@@ -1175,14 +1209,14 @@ ulong CPU::LD_A_0xFF00n(byte opcode)
 {
 	byte n = ReadBytePCI();
 	byte value = m_MMU->ReadByte(0xFF00 + n);
-	SetHighByte(&m_AF, value);
+	SetHighByte(&m_state->AF, value);
 
 	return 12;
 }
 
 ulong CPU::LD_0xFF00n_A(byte opcode)
 {
-	byte A = GetHighByte(m_AF);
+	byte A = GetHighByte(m_state->AF);
 	byte n = ReadBytePCI();
 	m_MMU->WriteByte(0xFF00 + n, A);
 
@@ -1191,17 +1225,17 @@ ulong CPU::LD_0xFF00n_A(byte opcode)
 
 ulong CPU::LD_A_0xFF00C(byte opcode)
 {
-	byte C = GetLowByte(m_BC);
+	byte C = GetLowByte(m_state->BC);
 	byte value = m_MMU->ReadByte(0xFF00 + C);
-	SetHighByte(&m_AF, value);
+	SetHighByte(&m_state->AF, value);
 
 	return 8;
 }
 
 ulong CPU::LD_0xFF00C_A(byte opcode)
 {
-	byte A = GetHighByte(m_AF);
-	byte C = GetLowByte(m_BC);
+	byte A = GetHighByte(m_state->AF);
+	byte C = GetLowByte(m_state->BC);
 	m_MMU->WriteByte(0xFF00 + C, A);
 
 	return 8;
@@ -1209,36 +1243,36 @@ ulong CPU::LD_0xFF00C_A(byte opcode)
 
 ulong CPU::LDI_0xHL_A(byte opcode)
 {
-	byte A = GetHighByte(m_AF);
-	m_MMU->WriteByte(m_HL, A);
-	m_HL++;
+	byte A = GetHighByte(m_state->AF);
+	m_MMU->WriteByte(m_state->HL, A);
+	m_state->HL++;
 
 	return 8;
 }
 
 ulong CPU::LDI_A_0xHL(byte opcode)
 {
-	byte value = m_MMU->ReadByte(m_HL);
-	SetHighByte(&m_AF, value);
-	m_HL++;
+	byte value = m_MMU->ReadByte(m_state->HL);
+	SetHighByte(&m_state->AF, value);
+	m_state->HL++;
 
 	return 8;
 }
 
 ulong CPU::LDD_0xHL_A(byte opcode)
 {
-	byte A = GetHighByte(m_AF);
-	m_MMU->WriteByte(m_HL, A);
-	m_HL--;
+	byte A = GetHighByte(m_state->AF);
+	m_MMU->WriteByte(m_state->HL, A);
+	m_state->HL--;
 
 	return 8;
 }
 
 ulong CPU::LDD_A_0xHL(byte opcode)
 {
-	byte value = m_MMU->ReadByte(m_HL);
-	SetHighByte(&m_AF, value);
-	m_HL--;
+	byte value = m_MMU->ReadByte(m_state->HL);
+	SetHighByte(&m_state->AF, value);
+	m_state->HL--;
 
 	return 8;
 }
@@ -1246,7 +1280,7 @@ ulong CPU::LDD_A_0xHL(byte opcode)
 ulong CPU::LD_0xnn_SP(byte opcode)
 {
 	ushort nn = ReadUShortPCI();
-	m_MMU->WriteUShort(nn, m_SP);
+	m_MMU->WriteUShort(nn, m_state->SP);
 
 	return 20;
 }
@@ -1262,7 +1296,7 @@ ulong CPU::LD_rr_nn(byte opcode)
 
 ulong CPU::LD_SP_HL(byte opcode)
 {
-	m_SP = m_HL;
+	m_state->SP = m_state->HL;
 
 	return 8;
 }
@@ -1286,136 +1320,136 @@ ulong CPU::POP_rr(byte opcode)
 
 ulong CPU::ADD_A_r(byte opcode)
 {
-	byte A = GetHighByte(m_AF);
+	byte A = GetHighByte(m_state->AF);
 	byte* r = GetByteRegister_Src(opcode);
 	byte result = AddBytes_Two(A, *r);
-	SetHighByte(&m_AF, result);
+	SetHighByte(&m_state->AF, result);
 
 	return 4;
 }
 
 ulong CPU::ADD_A_n(byte opcode)
 {
-	byte A = GetHighByte(m_AF);
+	byte A = GetHighByte(m_state->AF);
 	byte n = ReadBytePCI();
 	byte result = AddBytes_Two(A, n);
-	SetHighByte(&m_AF, result);
+	SetHighByte(&m_state->AF, result);
 
 	return 8;
 }
 
 ulong CPU::ADD_A_0xHL(byte opcode)
 {
-	byte A = GetHighByte(m_AF);
-	byte value = m_MMU->ReadByte(m_HL);
+	byte A = GetHighByte(m_state->AF);
+	byte value = m_MMU->ReadByte(m_state->HL);
 	byte result = AddBytes_Two(A, value);
-	SetHighByte(&m_AF, result);
+	SetHighByte(&m_state->AF, result);
 
 	return 8;
 }
 
 ulong CPU::ADC_A_r(byte opcode)
 {
-	byte A = GetHighByte(m_AF);
+	byte A = GetHighByte(m_state->AF);
 	byte* r = GetByteRegister_Src(opcode);
 	byte cf = GetFlag(CarryFlag);
 	byte result = AddBytes_Three(A, *r, cf);
-	SetHighByte(&m_AF, result);
+	SetHighByte(&m_state->AF, result);
 
 	return 4;
 }
 
 ulong CPU::ADC_A_n(byte opcode)
 {
-	byte A = GetHighByte(m_AF);
+	byte A = GetHighByte(m_state->AF);
 	byte n = ReadBytePCI();
 	byte cf = GetFlag(CarryFlag);
 	byte result = AddBytes_Three(A, n, cf);
-	SetHighByte(&m_AF, result);
+	SetHighByte(&m_state->AF, result);
 
 	return 8;
 }
 
 ulong CPU::ADC_A_0xHL(byte opcode)
 {
-	byte A = GetHighByte(m_AF);
-	byte value = m_MMU->ReadByte(m_HL);
+	byte A = GetHighByte(m_state->AF);
+	byte value = m_MMU->ReadByte(m_state->HL);
 	byte cf = GetFlag(CarryFlag);
 	byte result = AddBytes_Three(A, value, cf);
-	SetHighByte(&m_AF, result);
+	SetHighByte(&m_state->AF, result);
 
 	return 8;
 }
 
 ulong CPU::SUB_A_r(byte opcode)
 {
-	byte A = GetHighByte(m_AF);
+	byte A = GetHighByte(m_state->AF);
 	byte* r = GetByteRegister_Src(opcode);
 	byte result = SubtractBytes_Two(A, *r);
-	SetHighByte(&m_AF, result);
+	SetHighByte(&m_state->AF, result);
 
 	return 4;
 }
 
 ulong CPU::SUB_A_n(byte opcode)
 {
-	byte A = GetHighByte(m_AF);
+	byte A = GetHighByte(m_state->AF);
 	byte n = ReadBytePCI();
 	byte result = SubtractBytes_Two(A, n);
-	SetHighByte(&m_AF, result);
+	SetHighByte(&m_state->AF, result);
 
 	return 8;
 }
 
 ulong CPU::SUB_A_0xHL(byte opcode)
 {
-	byte A = GetHighByte(m_AF);
-	byte value = m_MMU->ReadByte(m_HL);
+	byte A = GetHighByte(m_state->AF);
+	byte value = m_MMU->ReadByte(m_state->HL);
 	byte result = SubtractBytes_Two(A, value);
-	SetHighByte(&m_AF, result);
+	SetHighByte(&m_state->AF, result);
 
 	return 8;
 }
 
 ulong CPU::SBC_A_r(byte opcode)
 {
-	byte A = GetHighByte(m_AF);
+	byte A = GetHighByte(m_state->AF);
 	byte* r = GetByteRegister_Src(opcode);
 	byte cf = GetFlag(CarryFlag);
 	byte result = SubtractBytes_Three(A, *r, cf);
-	SetHighByte(&m_AF, result);
+	SetHighByte(&m_state->AF, result);
 
 	return 4;
 }
 
 ulong CPU::SBC_A_n(byte opcode)
 {
-	byte A = GetHighByte(m_AF);
+	byte A = GetHighByte(m_state->AF);
 	byte n = ReadBytePCI();
 	byte cf = GetFlag(CarryFlag);
 	byte result = SubtractBytes_Three(A, n, cf);
-	SetHighByte(&m_AF, result);
+	SetHighByte(&m_state->AF, result);
 
 	return 8;
 }
 
 ulong CPU::SBC_A_0xHL(byte opcode)
 {
-	byte A = GetHighByte(m_AF);
-	byte value = m_MMU->ReadByte(m_HL);
+	byte A = GetHighByte(m_state->AF);
+	byte value = m_MMU->ReadByte(m_state->HL);
 	byte cf = GetFlag(CarryFlag);
 	byte result = SubtractBytes_Three(A, value, cf);
-	SetHighByte(&m_AF, result);
+	SetHighByte(&m_state->AF, result);
 
 	return 8;
 }
 
 ulong CPU::AND_r(byte opcode)
 {
-	byte A = GetHighByte(m_AF);
+	byte A = GetHighByte(m_state->AF);
 	byte* r = GetByteRegister_Src(opcode);
 	byte result = A & *r;
-	SetHighByte(&m_AF, result);
+	SetHighByte(&m_state->AF, result);
 
 	(result == 0x00) ? SetFlag(ZeroFlag) : ClearFlag(ZeroFlag);
 	ClearFlag(SubtractFlag);
@@ -1427,10 +1461,10 @@ ulong CPU::AND_r(byte opcode)
 
 ulong CPU::AND_n(byte opcode)
 {
-	byte A = GetHighByte(m_AF);
+	byte A = GetHighByte(m_state->AF);
 	byte n = ReadBytePCI();
 	byte result = A & n;
-	SetHighByte(&m_AF, result);
+	SetHighByte(&m_state->AF, result);
 
 	(result == 0x00) ? SetFlag(ZeroFlag) : ClearFlag(ZeroFlag);
 	ClearFlag(SubtractFlag);
@@ -1442,10 +1476,10 @@ ulong CPU::AND_n(byte opcode)
 
 ulong CPU::AND_0xHL(byte opcode)
 {
-	byte A = GetHighByte(m_AF);
-	byte value = m_MMU->ReadByte(m_HL);
+	byte A = GetHighByte(m_state->AF);
+	byte value = m_MMU->ReadByte(m_state->HL);
 	byte result = A & value;
-	SetHighByte(&m_AF, result);
+	SetHighByte(&m_state->AF, result);
 
 	(result == 0x00) ? SetFlag(ZeroFlag) : ClearFlag(ZeroFlag);
 	ClearFlag(SubtractFlag);
@@ -1457,10 +1491,10 @@ ulong CPU::AND_0xHL(byte opcode)
 
 ulong CPU::XOR_r(byte opcode)
 {
-	byte A = GetHighByte(m_AF);
+	byte A = GetHighByte(m_state->AF);
 	byte* r = GetByteRegister_Src(opcode);
 	byte result = A ^ *r;
-	SetHighByte(&m_AF, result);
+	SetHighByte(&m_state->AF, result);
 
 	(result == 0x00) ? SetFlag(ZeroFlag) : ClearFlag(ZeroFlag);
 	ClearFlag(SubtractFlag);
@@ -1472,10 +1506,10 @@ ulong CPU::XOR_r(byte opcode)
 
 ulong CPU::XOR_n(byte opcode)
 {
-	byte A = GetHighByte(m_AF);
+	byte A = GetHighByte(m_state->AF);
 	byte n = ReadBytePCI();
 	byte result = A ^ n;
-	SetHighByte(&m_AF, result);
+	SetHighByte(&m_state->AF, result);
 
 	(result == 0x00) ? SetFlag(ZeroFlag) : ClearFlag(ZeroFlag);
 	ClearFlag(SubtractFlag);
@@ -1487,10 +1521,10 @@ ulong CPU::XOR_n(byte opcode)
 
 ulong CPU::XOR_0xHL(byte opcode)
 {
-	byte A = GetHighByte(m_AF);
-	byte value = m_MMU->ReadByte(m_HL);
+	byte A = GetHighByte(m_state->AF);
+	byte value = m_MMU->ReadByte(m_state->HL);
 	byte result = A ^ value;
-	SetHighByte(&m_AF, result);
+	SetHighByte(&m_state->AF, result);
 
 	(result == 0x00) ? SetFlag(ZeroFlag) : ClearFlag(ZeroFlag);
 	ClearFlag(SubtractFlag);
@@ -1502,10 +1536,10 @@ ulong CPU::XOR_0xHL(byte opcode)
 
 ulong CPU::OR_r(byte opcode)
 {
-	byte A = GetHighByte(m_AF);
+	byte A = GetHighByte(m_state->AF);
 	byte* r = GetByteRegister_Src(opcode);
 	byte result = A | *r;
-	SetHighByte(&m_AF, result);
+	SetHighByte(&m_state->AF, result);
 
 	(result == 0x00) ? SetFlag(ZeroFlag) : ClearFlag(ZeroFlag);
 	ClearFlag(SubtractFlag);
@@ -1517,10 +1551,10 @@ ulong CPU::OR_r(byte opcode)
 
 ulong CPU::OR_n(byte opcode)
 {
-	byte A = GetHighByte(m_AF);
+	byte A = GetHighByte(m_state->AF);
 	byte n = ReadBytePCI();
 	byte result = A | n;
-	SetHighByte(&m_AF, result);
+	SetHighByte(&m_state->AF, result);
 
 	(result == 0x00) ? SetFlag(ZeroFlag) : ClearFlag(ZeroFlag);
 	ClearFlag(SubtractFlag);
@@ -1532,10 +1566,10 @@ ulong CPU::OR_n(byte opcode)
 
 ulong CPU::OR_0xHL(byte opcode)
 {
-	byte A = GetHighByte(m_AF);
-	byte value = m_MMU->ReadByte(m_HL);
+	byte A = GetHighByte(m_state->AF);
+	byte value = m_MMU->ReadByte(m_state->HL);
 	byte result = A | value;
-	SetHighByte(&m_AF, result);
+	SetHighByte(&m_state->AF, result);
 
 	(result == 0x00) ? SetFlag(ZeroFlag) : ClearFlag(ZeroFlag);
 	ClearFlag(SubtractFlag);
@@ -1547,30 +1581,30 @@ ulong CPU::OR_0xHL(byte opcode)
 
 ulong CPU::CP_r(byte opcode)
 {
-	byte A = GetHighByte(m_AF);
+	byte A = GetHighByte(m_state->AF);
 	byte* r = GetByteRegister_Src(opcode);
 	byte flags = CompareBytes(A, *r);
-	SetLowByte(&m_AF, flags);
+	SetLowByte(&m_state->AF, flags);
 
 	return 4;
 }
 
 ulong CPU::CP_n(byte opcode)
 {
-	byte A = GetHighByte(m_AF);
+	byte A = GetHighByte(m_state->AF);
 	byte n = ReadBytePCI();
 	byte flags = CompareBytes(A, n);
-	SetLowByte(&m_AF, flags);
+	SetLowByte(&m_state->AF, flags);
 
 	return 8;
 }
 
 ulong CPU::CP_0xHL(byte opcode)
 {
-	byte A = GetHighByte(m_AF);
-	byte value = m_MMU->ReadByte(m_HL);
+	byte A = GetHighByte(m_state->AF);
+	byte value = m_MMU->ReadByte(m_state->HL);
 	byte flags = CompareBytes(A, value);
-	SetLowByte(&m_AF, flags);
+	SetLowByte(&m_state->AF, flags);
 
 	return 8;
 }
@@ -1586,9 +1620,9 @@ ulong CPU::INC_r(byte opcode)
 
 ulong CPU::INC_0xHL(byte opcode)
 {
-	byte value = m_MMU->ReadByte(m_HL);
+	byte value = m_MMU->ReadByte(m_state->HL);
 	byte result = AddBytes_Two(value, 1, /*affectedFlags =*/ ZeroFlagMask | SubtractFlagMask | HalfCarryFlagMask);
-	m_MMU->WriteByte(m_HL, result);
+	m_MMU->WriteByte(m_state->HL, result);
 
 	return 12;
 }
@@ -1604,9 +1638,9 @@ ulong CPU::DEC_r(byte opcode)
 
 ulong CPU::DEC_0xHL(byte opcode)
 {
-	byte value = m_MMU->ReadByte(m_HL);
+	byte value = m_MMU->ReadByte(m_state->HL);
 	byte result = SubtractBytes_Two(value, 1, /*affectedFlags =*/ ZeroFlagMask | SubtractFlagMask | HalfCarryFlagMask);
-	m_MMU->WriteByte(m_HL, result);
+	m_MMU->WriteByte(m_state->HL, result);
 
 	return 12;
 }
@@ -1666,7 +1700,7 @@ Example:
 */
 ulong CPU::DAA(byte opcode)
 {
-	byte A = GetHighByte(m_AF);
+	byte A = GetHighByte(m_state->AF);
 	byte err = 0x00; // error
 	byte c = GetFlag(CarryFlag);
 	byte h = GetFlag(HalfCarryFlag);
@@ -1700,7 +1734,7 @@ ulong CPU::DAA(byte opcode)
 	}
 
 	byte result = A + err;
-	SetHighByte(&m_AF, result);
+	SetHighByte(&m_state->AF, result);
 
 	(result == 0x00) ? SetFlag(ZeroFlag) : ClearFlag(ZeroFlag);
 	ClearFlag(HalfCarryFlag);
@@ -1715,9 +1749,9 @@ ulong CPU::DAA(byte opcode)
 
 ulong CPU::CPL(byte opcode)
 {
-	byte A = GetHighByte(m_AF);
+	byte A = GetHighByte(m_state->AF);
 	byte result = A ^ 0xFF;
-	SetHighByte(&m_AF, result);
+	SetHighByte(&m_state->AF, result);
 
 	SetFlag(SubtractFlag);
 	SetFlag(HalfCarryFlag);
@@ -1728,8 +1762,8 @@ ulong CPU::CPL(byte opcode)
 ulong CPU::ADD_HL_rr(byte opcode)
 {
 	ushort* rr = GetUShortRegister(opcode);
-	ushort result = AddUShorts_Two(m_HL, *rr, /*affectedFlags =*/ SubtractFlagMask | HalfCarryFlagMask | CarryFlagMask);
-	m_HL = result;
+	ushort result = AddUShorts_Two(m_state->HL, *rr, /*affectedFlags =*/ SubtractFlagMask | HalfCarryFlagMask | CarryFlagMask);
+	m_state->HL = result;
 
 	return 8;
 }
@@ -1755,14 +1789,14 @@ ulong CPU::DEC_rr(byte opcode)
 ulong CPU::ADD_SP_dd(byte opcode)
 {
 	sbyte dd = (sbyte)ReadBytePCI();
-	ushort result = (m_SP + dd);
+	ushort result = (m_state->SP + dd);
 
 	ClearFlag(ZeroFlag);
 	ClearFlag(SubtractFlag);
-	((result & 0x0F) < (m_SP & 0x0F)) ? SetFlag(HalfCarryFlag) : ClearFlag(HalfCarryFlag);
-	((result & 0xFF) < (m_SP & 0xFF)) ? SetFlag(CarryFlag) : ClearFlag(CarryFlag);
+	((result & 0x0F) < (m_state->SP & 0x0F)) ? SetFlag(HalfCarryFlag) : ClearFlag(HalfCarryFlag);
+	((result & 0xFF) < (m_state->SP & 0xFF)) ? SetFlag(CarryFlag) : ClearFlag(CarryFlag);
 
-	m_SP = result;
+	m_state->SP = result;
 
 	return 16;
 }
@@ -1770,48 +1804,48 @@ ulong CPU::ADD_SP_dd(byte opcode)
 ulong CPU::LD_HL_SPdd(byte opcode)
 {
 	sbyte dd = (sbyte)ReadBytePCI();
-	ushort result = (m_SP + dd);
+	ushort result = (m_state->SP + dd);
 
 	ClearFlag(ZeroFlag);
 	ClearFlag(SubtractFlag);
-	((result & 0x0F) < (m_SP & 0x0F)) ? SetFlag(HalfCarryFlag) : ClearFlag(HalfCarryFlag);
-	((result & 0xFF) < (m_SP & 0xFF)) ? SetFlag(CarryFlag) : ClearFlag(CarryFlag);
+	((result & 0x0F) < (m_state->SP & 0x0F)) ? SetFlag(HalfCarryFlag) : ClearFlag(HalfCarryFlag);
+	((result & 0xFF) < (m_state->SP & 0xFF)) ? SetFlag(CarryFlag) : ClearFlag(CarryFlag);
 
 	return 12;
 }
 
 ulong CPU::RLCA(byte opcode)
 {
-	byte A = GetHighByte(m_AF);
+	byte A = GetHighByte(m_state->AF);
 	byte result = RotateLeft(A, /*clearZeroFlag =*/ true);
-	SetHighByte(&m_AF, result);
+	SetHighByte(&m_state->AF, result);
 
 	return 4;
 }
 
 ulong CPU::RLA(byte opcode)
 {
-	byte A = GetHighByte(m_AF);
+	byte A = GetHighByte(m_state->AF);
 	byte result = RotateLeftThroughCarry(A, /*clearZeroFlag =*/ true);
-	SetHighByte(&m_AF, result);
+	SetHighByte(&m_state->AF, result);
 
 	return 4;
 }
 
 ulong CPU::RRCA(byte opcode)
 {
-	byte A = GetHighByte(m_AF);
+	byte A = GetHighByte(m_state->AF);
 	byte result = RotateRight(A, /*clearZeroFlag =*/ true);
-	SetHighByte(&m_AF, result);
+	SetHighByte(&m_state->AF, result);
 
 	return 4;
 }
 
 ulong CPU::RRA(byte opcode)
 {
-	byte A = GetHighByte(m_AF);
+	byte A = GetHighByte(m_state->AF);
 	byte result = RotateRightThroughCarry(A, /*clearZeroFlag =*/ true);
-	SetHighByte(&m_AF, result);
+	SetHighByte(&m_state->AF, result);
 
 	return 4;
 }
@@ -1827,9 +1861,9 @@ ulong CPU::RLC_r(byte opcode)
 
 ulong CPU::RLC_0xHL(byte opcode)
 {
-	byte value = m_MMU->ReadByte(m_HL);
+	byte value = m_MMU->ReadByte(m_state->HL);
 	byte result = RotateLeft(value);
-	m_MMU->WriteByte(m_HL, result);
+	m_MMU->WriteByte(m_state->HL, result);
 
 	return 16;
 }
@@ -1845,9 +1879,9 @@ ulong CPU::RL_r(byte opcode)
 
 ulong CPU::RL_0xHL(byte opcode)
 {
-	byte value = m_MMU->ReadByte(m_HL);
+	byte value = m_MMU->ReadByte(m_state->HL);
 	byte result = RotateLeftThroughCarry(value);
-	m_MMU->WriteByte(m_HL, result);
+	m_MMU->WriteByte(m_state->HL, result);
 
 	return 16;
 }
@@ -1863,9 +1897,9 @@ ulong CPU::RRC_r(byte opcode)
 
 ulong CPU::RRC_0xHL(byte opcode)
 {
-	byte value = m_MMU->ReadByte(m_HL);
+	byte value = m_MMU->ReadByte(m_state->HL);
 	byte result = RotateRight(value);
-	m_MMU->WriteByte(m_HL, result);
+	m_MMU->WriteByte(m_state->HL, result);
 
 	return 16;
 }
@@ -1881,9 +1915,9 @@ ulong CPU::RR_r(byte opcode)
 
 ulong CPU::RR_0xHL(byte opcode)
 {
-	byte value = m_MMU->ReadByte(m_HL);
+	byte value = m_MMU->ReadByte(m_state->HL);
 	byte result = RotateRightThroughCarry(value);
-	m_MMU->WriteByte(m_HL, result);
+	m_MMU->WriteByte(m_state->HL, result);
 
 	return 16;
 }
@@ -1904,10 +1938,10 @@ ulong CPU::SLA_r(byte opcode)
 
 ulong CPU::SLA_0xHL(byte opcode)
 {
-	byte value = m_MMU->ReadByte(m_HL);
+	byte value = m_MMU->ReadByte(m_state->HL);
 	byte cf = GET_BIT(value, 7);
 	byte result = (value << 1);
-	m_MMU->WriteByte(m_HL, result);
+	m_MMU->WriteByte(m_state->HL, result);
 
 	(result == 0) ? SetFlag(ZeroFlag) : ClearFlag(ZeroFlag);
 	ClearFlag(SubtractFlag);
@@ -1933,10 +1967,10 @@ ulong CPU::SRA_r(byte opcode)
 
 ulong CPU::SRA_0xHL(byte opcode)
 {
-	byte value = m_MMU->ReadByte(m_HL);
+	byte value = m_MMU->ReadByte(m_state->HL);
 	byte cf = GET_BIT(value, 0);
 	byte result = (value >> 1) | (value & 0x80);
-	m_MMU->WriteByte(m_HL, result);
+	m_MMU->WriteByte(m_state->HL, result);
 
 	(result == 0) ? SetFlag(ZeroFlag) : ClearFlag(ZeroFlag);
 	ClearFlag(SubtractFlag);
@@ -1962,10 +1996,10 @@ ulong CPU::SRL_r(byte opcode)
 
 ulong CPU::SRL_0xHL(byte opcode)
 {
-	byte value = m_MMU->ReadByte(m_HL);
+	byte value = m_MMU->ReadByte(m_state->HL);
 	byte cf = GET_BIT(value, 0);
 	byte result = (value >> 1);
-	m_MMU->WriteByte(m_HL, result);
+	m_MMU->WriteByte(m_state->HL, result);
 
 	(result == 0) ? SetFlag(ZeroFlag) : ClearFlag(ZeroFlag);
 	ClearFlag(SubtractFlag);
@@ -1992,11 +2026,11 @@ ulong CPU::SWAP_r(byte opcode)
 
 ulong CPU::SWAP_0xHL(byte opcode)
 {
-	byte value = m_MMU->ReadByte(m_HL);
+	byte value = m_MMU->ReadByte(m_state->HL);
 	byte low = (value & 0x0F);
 	byte high = (value & 0xF0);
 	byte result = (low << 4) | (high >> 4);
-	m_MMU->WriteByte(m_HL, result);
+	m_MMU->WriteByte(m_state->HL, result);
 
 	(result == 0) ? SetFlag(ZeroFlag) : ClearFlag(ZeroFlag);
 	ClearFlag(SubtractFlag);
@@ -2021,7 +2055,7 @@ ulong CPU::BIT_n_r(byte opcode)
 ulong CPU::BIT_n_0xHL(byte opcode)
 {
 	byte bit = (opcode >> 3) & 0x07;
-	byte value = m_MMU->ReadByte(m_HL);
+	byte value = m_MMU->ReadByte(m_state->HL);
 
 	!IS_BIT_SET(value, bit) ? SetFlag(ZeroFlag) : ClearFlag(ZeroFlag);
 	ClearFlag(SubtractFlag);
@@ -2042,9 +2076,9 @@ ulong CPU::SET_n_r(byte opcode)
 ulong CPU::SET_n_0xHL(byte opcode)
 {
 	byte bit = (opcode >> 3) & 0x07;
-	byte value = m_MMU->ReadByte(m_HL);
+	byte value = m_MMU->ReadByte(m_state->HL);
 	byte result = SET_BIT(value, bit);
-	m_MMU->WriteByte(m_HL, result);
+	m_MMU->WriteByte(m_state->HL, result);
 
 	return 16;
 }
@@ -2061,9 +2095,9 @@ ulong CPU::RES_n_r(byte opcode)
 ulong CPU::RES_n_0xHL(byte opcode)
 {
 	byte bit = (opcode >> 3) & 0x07;
-	byte value = m_MMU->ReadByte(m_HL);
+	byte value = m_MMU->ReadByte(m_state->HL);
 	byte result = CLEAR_BIT(value, bit);
-	m_MMU->WriteByte(m_HL, result);
+	m_MMU->WriteByte(m_state->HL, result);
 
 	return 16;
 }
@@ -2093,7 +2127,7 @@ ulong CPU::NOP(byte opcode)
 
 ulong CPU::HALT(byte opcode)
 {
-	m_isHalted = true;
+	m_state->isHalted = true;
 
 	return 4;
 }
@@ -2105,14 +2139,14 @@ ulong CPU::STOP(byte opcode)
 
 ulong CPU::DI(byte opcode)
 {
-	m_IME = 0;
+	m_state->IME = 0;
 
 	return 4;
 }
 
 ulong CPU::EI(byte opcode)
 {
-	m_IME = 1;
+	m_state->IME = 1;
 
 	return 4;
 }
@@ -2120,14 +2154,14 @@ ulong CPU::EI(byte opcode)
 ulong CPU::JP_nn(byte opcode)
 {
 	ushort nn = ReadUShortPCI();
-	m_PC = nn;
+	m_state->PC = nn;
 
 	return 16;
 }
 
 ulong CPU::JP_HL(byte opcode)
 {
-	m_PC = m_HL;
+	m_state->PC = m_state->HL;
 
 	return 4;
 }
@@ -2140,7 +2174,7 @@ ulong CPU::JP_cc_nn(byte opcode)
 ulong CPU::JR_dd(byte opcode)
 {
 	sbyte dd = (sbyte)ReadBytePCI();
-	m_PC += dd;
+	m_state->PC += dd;
 
 	return 12;
 }
@@ -2153,8 +2187,8 @@ ulong CPU::JR_cc_dd(byte opcode)
 ulong CPU::CALL_nn(byte opcode)
 {
 	ushort nn = ReadUShortPCI();
-	PushUShortToStack(m_PC);
-	m_PC = nn;
+	PushUShortToStack(m_state->PC);
+	m_state->PC = nn;
 
 	return 24;
 }
@@ -2166,7 +2200,7 @@ ulong CPU::CALL_cc_nn(byte opcode)
 
 ulong CPU::RET(byte opcode)
 {
-	m_PC = PopUShortFromStack();
+	m_state->PC = PopUShortFromStack();
 
 	return 16;
 }
@@ -2178,8 +2212,8 @@ ulong CPU::RET_cc(byte opcode)
 
 ulong CPU::RETI(byte opcode)
 {
-	m_IME = 1;
-	m_PC = PopUShortFromStack();
+	m_state->IME = 1;
+	m_state->PC = PopUShortFromStack();
 
 	return 16;
 }
@@ -2195,9 +2229,9 @@ ulong CPU::RST_n(byte opcode)
 	// 101 - 0x28
 	// 110 - 0x30
 	// 111 - 0x38
-	PushUShortToStack(m_PC);
+	PushUShortToStack(m_state->PC);
 	byte n = ((opcode >> 3) & 0x07);
-	m_PC = (ushort)(n);
+	m_state->PC = (ushort)(n);
 
 	return 16;
 }
@@ -3,8 +3,27 @@
 #include "PCH.h"
 #include "MMU.h"
 
+class StateArena;
+
 class CPU
 {
+public:
+	/** The registers and the execution state. Lives in the state arena */
+	struct State
+	{
+		ulong cycles; // Total cycles
+		bool isHalted;
+		byte IME; // Interrupt master enabled
+
+		// Registers
+		ushort AF; // Accumulator & Flags;
+		ushort BC; // General purpose
+		ushort DE; // General purpose
+		ushort HL; // General purpose
+		ushort SP; // Stack pointer
+		ushort PC; // Program counter
+	};
+
 private:
 	// The Flag Register(lower 8bit of AF register)
 	// Bit  Name  Set  Clr  Expl.
@@ -43,34 +62,30 @@ private:
 	static const byte AllFlagsMask;
 
 private:
-	ulong m_cycles; // Total cycles
-	bool m_isHalted;
-	byte m_IME; // Interrupt master enabled
-
-	// Registers
-	ushort m_AF; // Accumulator & Flags;
-	ushort m_BC; // General purpose
-	ushort m_DE; // General purpose
-	ushort m_HL; // General purpose
-	ushort m_SP; // Stack pointer
-	ushort m_PC; // Program counter
+	State* m_state;
 
 	byte* m_byteRegisterMap[0x08]; // For easy access to the 8bit registers (A, B, C, D, E, H, L). F is not used
 	ushort* m_ushortRegisterMap[0x04]; // For easy access to the 16bit registers (BC, DE, HL, SP)
 
-	std::unique_ptr<MMU> m_MMU;
+	MMU* m_MMU;
 
 	typedef ulong(CPU::*InstructionFunction)(byte opcode);
 	InstructionFunction m_instructionMap[0x100];
 	InstructionFunction m_instructionMapCB[0x100];
 
 public:
-	CPU();
+	CPU(MMU* mmu, StateArena* arena);
 
 	/** Returns the number of cycles each step takes */
 	ulong Step();
 
 private:
+	/**
+	* Service the highest priority interrupt that is both requested (IF) and enabled (IE).
+	* Returns the number of cycles it took, or 0 if no interrupt was serviced.
+	*/
+	ulong HandleInterrupts();
+
 	/** Read 1 byte and increment PC by 1 */
 	byte ReadBytePCI();
 
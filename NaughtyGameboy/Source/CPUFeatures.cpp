@@ -0,0 +1,64 @@
+#include "CPUFeatures.h"
+
+#if HAS_X86_SIMD
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#if HAS_X86_SIMD
+static void GetCPUID(int leaf, int subleaf, uint registers[4])
+{
+#if defined(_MSC_VER)
+	__cpuidex(reinterpret_cast<int*>(registers), leaf, subleaf);
+#else
+	__cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+}
+
+static ulonglong GetXCR0()
+{
+#if defined(_MSC_VER)
+	return _xgetbv(0);
+#else
+	uint eax, edx;
+	__asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((ulonglong)edx << 32) | eax;
+#endif
+}
+#endif
+
+const CPUFeatures& CPUFeatures::Get()
+{
+	static const CPUFeatures features = Detect();
+	return features;
+}
+
+CPUFeatures CPUFeatures::Detect()
+{
+	CPUFeatures features;
+	features.hasSSE2 = false;
+	features.hasAVX2 = false;
+
+#if HAS_X86_SIMD
+	uint registers[4]; // EAX, EBX, ECX, EDX
+	GetCPUID(0, 0, registers);
+	uint maxLeaf = registers[0];
+
+	GetCPUID(1, 0, registers);
+	features.hasSSE2 = ((registers[3] >> 26) & 1) != 0;
+
+	// AVX2 also needs the OS to save the YMM registers
+	bool hasOSXSAVE = ((registers[2] >> 27) & 1) != 0;
+	bool hasAVX = ((registers[2] >> 28) & 1) != 0;
+	if (hasOSXSAVE && hasAVX && (GetXCR0() & 0x6) == 0x6 && maxLeaf >= 7)
+	{
+		GetCPUID(7, 0, registers);
+		features.hasAVX2 = ((registers[1] >> 5) & 1) != 0;
+	}
+#endif
+
+	return features;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "PCH.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define HAS_X86_SIMD 1
+#else
+#define HAS_X86_SIMD 0
+#endif
+
+// Functions that use AVX2 intrinsics are compiled for AVX2, while the rest of the translation unit isn't.
+// They must only be called when CPUFeatures reports AVX2. MSVC allows the intrinsics without any flags
+#if HAS_X86_SIMD && !defined(_MSC_VER)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+/** The SIMD instruction sets that the host CPU and OS support. Detected once at startup */
+struct CPUFeatures
+{
+	bool hasSSE2;
+	bool hasAVX2;
+
+	static const CPUFeatures& Get();
+
+private:
+	static CPUFeatures Detect();
+};
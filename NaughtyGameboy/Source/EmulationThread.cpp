@@ -0,0 +1,76 @@
+#include "EmulationThread.h"
+#include "Gameboy.h"
+#include "TripleBuffer.h"
+
+EmulationThread::EmulationThread(const std::vector<Gameboy*>& instances, const std::vector<TripleBuffer*>& outputs, ulong frameLimit) :
+	m_instances(instances),
+	m_outputs(outputs),
+	m_frameLimit(frameLimit),
+	m_isStopping(false),
+	m_isDone(false),
+	m_frameCount(0)
+{
+	// The instances draw straight into the back buffers, so publishing a frame doesn't copy it
+	for (size_t i = 0; i < m_instances.size(); i++)
+	{
+		m_instances[i]->GetPPU()->SetFramebuffer(m_outputs[i]->GetBackBuffer());
+	}
+
+	m_thread = std::thread(&EmulationThread::Run, this);
+}
+
+EmulationThread::~EmulationThread()
+{
+	Stop();
+}
+
+void EmulationThread::Stop()
+{
+	m_isStopping.store(true, std::memory_order_relaxed);
+	if (m_thread.joinable())
+	{
+		m_thread.join();
+	}
+}
+
+bool EmulationThread::IsDone() const
+{
+	return m_isDone.load(std::memory_order_acquire);
+}
+
+ulonglong EmulationThread::GetFrameCount() const
+{
+	return m_frameCount.load(std::memory_order_relaxed);
+}
+
+void EmulationThread::RunFrame(Gameboy* instance)
+{
+	ulong frameCount = instance->GetPPU()->GetFrameCount();
+	ulong cycles = 0;
+	while (cycles < CyclesPerFrame && instance->GetPPU()->GetFrameCount() == frameCount)
+	{
+		cycles += instance->Step();
+	}
+}
+
+void EmulationThread::Run()
+{
+	ulong frames = 0;
+	while (!m_isStopping.load(std::memory_order_relaxed) && (m_frameLimit == 0 || frames < m_frameLimit))
+	{
+		for (size_t i = 0; i < m_instances.size(); i++)
+		{
+			PPU* ppu = m_instances[i]->GetPPU();
+			RunFrame(m_instances[i]);
+
+			ppu->GetPixels(); // Waits for the render worker to finish the frame
+			m_outputs[i]->Publish();
+			ppu->SetFramebuffer(m_outputs[i]->GetBackBuffer());
+		}
+
+		frames++;
+		m_frameCount.fetch_add(m_instances.size(), std::memory_order_relaxed);
+	}
+
+	m_isDone.store(true, std::memory_order_release);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "PCH.h"
+
+class Gameboy;
+class TripleBuffer;
+
+/**
+* Runs emulator instances on a thread of its own, as fast as it can. The instances take turns a frame at a time.
+* Each instance draws into the back buffer of its triple buffer, and every completed frame is published from there.
+* Nothing ever waits for the consumers of the frames, they take the newest one whenever they want.
+*/
+class EmulationThread
+{
+public:
+	static const ulong CyclesPerFrame = 70224;
+
+private:
+	std::vector<Gameboy*> m_instances;
+	std::vector<TripleBuffer*> m_outputs;
+	ulong m_frameLimit; // Frames per instance. 0 runs until Stop
+
+	std::atomic<bool> m_isStopping;
+	std::atomic<bool> m_isDone;
+	std::atomic<ulonglong> m_frameCount;
+
+	std::thread m_thread;
+
+public:
+	/** outputs[i] gets the frames of instances[i], which must draw ARGB8888. Both must stay alive as long as the thread */
+	EmulationThread(const std::vector<Gameboy*>& instances, const std::vector<TripleBuffer*>& outputs, ulong frameLimit);
+
+	/** Stops the thread */
+	~EmulationThread();
+
+	EmulationThread(const EmulationThread&) = delete;
+	EmulationThread& operator=(const EmulationThread&) = delete;
+
+	/** Stop after the frame in progress and wait for the thread */
+	void Stop();
+
+	/** Whether every instance reached the frame limit */
+	bool IsDone() const;
+
+	/** The frames emulated by all the instances together */
+	ulonglong GetFrameCount() const;
+
+	/** Run instance until its next frame is complete, like the main loop. The cycle limit covers the LCD being off */
+	static void RunFrame(Gameboy* instance);
+
+private:
+	void Run();
+};
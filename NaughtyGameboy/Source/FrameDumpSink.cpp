@@ -0,0 +1,275 @@
+#include <algorithm>
+#include <cstring>
+#include "FrameDumpSink.h"
+#include "Logger.h"
+#include "PixelFormat.h"
+#include "PPURegisters.h"
+
+#ifdef _MSC_VER
+#define OpenPipe(command) _popen(command, "wb")
+#define ClosePipe(pipe) _pclose(pipe)
+#else
+#define OpenPipe(command) popen(command, "w")
+#define ClosePipe(pipe) pclose(pipe)
+#endif
+
+static const int ChromaWidth = LCDWidth / 2;
+static const int ChromaHeight = LCDHeight / 2;
+
+FrameDumpSink::FrameDumpSink(const char* path, FrameDumpFormat format, FrameDumpPolicy policy, int slotCount /*= DefaultSlotCount*/) :
+	m_format(format),
+	m_policy(policy),
+	m_file(nullptr),
+	m_isPipe(path[0] == '|'),
+	m_frames(std::make_unique<uint[]>(slotCount * LCDWidth * LCDHeight)),
+	m_outputSize((format == FrameDumpFormat::Y4M) ? LCDWidth * LCDHeight + 2 * ChromaWidth * ChromaHeight : LCDWidth * LCDHeight * 3),
+	m_filled(slotCount * 2),
+	m_free(slotCount),
+	m_frameCount(0),
+	m_droppedCount(0),
+	m_writtenCount(0),
+	m_hasWriteFailed(false)
+{
+	m_output = std::make_unique<byte[]>(m_outputSize);
+
+	m_file = m_isPipe ? OpenPipe(path + 1) : std::fopen(path, "wb");
+	if (m_file == nullptr)
+	{
+		Logger::LogError("Frame dump %s could not be opened", path);
+		return;
+	}
+
+	// The writer doesn't run yet, so this thread can stand in for it as the producer of the free slots
+	for (int i = 0; i < slotCount; i++)
+	{
+		m_free.TryPush(i);
+	}
+
+	WriteHeader();
+	m_thread = std::thread(&FrameDumpSink::Run, this);
+}
+
+FrameDumpSink::~FrameDumpSink()
+{
+	Close();
+}
+
+bool FrameDumpSink::IsOpen() const
+{
+	return m_file != nullptr;
+}
+
+void FrameDumpSink::Present(const uint* framebuffer)
+{
+	if (m_file == nullptr || framebuffer == nullptr)
+	{
+		return;
+	}
+
+	m_frameCount++;
+
+	int slot = TakeFreeSlot();
+	if (slot < 0)
+	{
+		m_droppedCount++;
+		return;
+	}
+
+	std::memcpy(&m_frames[slot * LCDWidth * LCDHeight], framebuffer, LCDWidth * LCDHeight * sizeof(uint));
+
+	// The filled queue has room for every slot, so the push can't fail
+	m_filled.TryPush(slot);
+}
+
+void FrameDumpSink::Close()
+{
+	if (m_file == nullptr)
+	{
+		return;
+	}
+
+	while (!m_filled.TryPush(-1))
+	{
+		std::this_thread::yield();
+	}
+
+	m_thread.join();
+
+	if (m_isPipe)
+	{
+		ClosePipe(m_file);
+	}
+	else
+	{
+		std::fclose(m_file);
+	}
+
+	m_file = nullptr;
+}
+
+ulonglong FrameDumpSink::GetFrameCount() const
+{
+	return m_frameCount;
+}
+
+ulonglong FrameDumpSink::GetDroppedCount() const
+{
+	return m_droppedCount;
+}
+
+ulonglong FrameDumpSink::GetWrittenCount() const
+{
+	return m_writtenCount.load(std::memory_order_acquire);
+}
+
+bool FrameDumpSink::HasWriteFailed() const
+{
+	return m_hasWriteFailed.load(std::memory_order_acquire);
+}
+
+FrameDumpFormat FrameDumpSink::GetFormat(const char* name)
+{
+	if (std::strcmp(name, "y4m") == 0)
+	{
+		return FrameDumpFormat::Y4M;
+	}
+
+	if (std::strcmp(name, "raw") == 0)
+	{
+		return FrameDumpFormat::RawRGB;
+	}
+
+	return FrameDumpFormat::Count;
+}
+
+void FrameDumpSink::Run()
+{
+	Backoff backoff;
+	while (true)
+	{
+		int slot;
+		if (!m_filled.TryPop(&slot))
+		{
+			backoff.Wait();
+			continue;
+		}
+
+		backoff.Reset();
+
+		if (slot < 0)
+		{
+			std::fflush(m_file);
+			return;
+		}
+
+		Write(&m_frames[slot * LCDWidth * LCDHeight]);
+		m_free.TryPush(slot);
+	}
+}
+
+void FrameDumpSink::WriteHeader()
+{
+	if (m_format != FrameDumpFormat::Y4M)
+	{
+		return;
+	}
+
+	// The exact frame rate of the Game Boy, 4194304 Hz / 70224 cycles per frame.
+	// Y4M defaults to limited range, so the full range samples are tagged with the XCOLORRANGE extension
+	std::fprintf(m_file, "YUV4MPEG2 W%d H%d F4194304:70224 Ip A1:1 C420jpeg XCOLORRANGE=FULL\n", LCDWidth, LCDHeight);
+}
+
+void FrameDumpSink::Write(const uint* frame)
+{
+	// After a failed write the frames are still taken, so the emulation doesn't stall on a dead pipe
+	if (m_hasWriteFailed.load(std::memory_order_relaxed))
+	{
+		return;
+	}
+
+	if (m_format == FrameDumpFormat::Y4M)
+	{
+		ConvertToY4M(frame);
+		std::fputs("FRAME\n", m_file);
+	}
+	else
+	{
+		ConvertToRGB(frame);
+	}
+
+	if (std::fwrite(m_output.get(), 1, m_outputSize, m_file) != m_outputSize)
+	{
+		m_hasWriteFailed.store(true, std::memory_order_release);
+		return;
+	}
+
+	m_writtenCount.fetch_add(1, std::memory_order_release);
+}
+
+void FrameDumpSink::ConvertToY4M(const uint* frame)
+{
+	// Full range BT.601, like JPEG. The DMG shades keep their exact gray levels
+	byte* luma = m_output.get();
+	for (int i = 0; i < LCDWidth * LCDHeight; i++)
+	{
+		luma[i] = PixelFormats::GetLuma(frame[i]);
+	}
+
+	// The chroma of every 2x2 block, from its average color
+	byte* blueChroma = luma + LCDWidth * LCDHeight;
+	byte* redChroma = blueChroma + ChromaWidth * ChromaHeight;
+	for (int y = 0; y < ChromaHeight; y++)
+	{
+		for (int x = 0; x < ChromaWidth; x++)
+		{
+			const uint* block = frame + y * 2 * LCDWidth + x * 2;
+			const uint pixels[] = { block[0], block[1], block[LCDWidth], block[LCDWidth + 1] };
+
+			int red = 0;
+			int green = 0;
+			int blue = 0;
+			for (uint pixel : pixels)
+			{
+				red += (pixel >> 16) & 0xFF;
+				green += (pixel >> 8) & 0xFF;
+				blue += pixel & 0xFF;
+			}
+
+			red = (red + 2) / 4;
+			green = (green + 2) / 4;
+			blue = (blue + 2) / 4;
+
+			// Offset by 128 << 8 so the sums never go negative before the shift. Pure blue and red round up to 256
+			blueChroma[y * ChromaWidth + x] = (byte)std::min((-43 * red - 85 * green + 128 * blue + 32768 + 128) >> 8, 255);
+			redChroma[y * ChromaWidth + x] = (byte)std::min((128 * red - 107 * green - 21 * blue + 32768 + 128) >> 8, 255);
+		}
+	}
+}
+
+void FrameDumpSink::ConvertToRGB(const uint* frame)
+{
+	byte* output = m_output.get();
+	for (int i = 0; i < LCDWidth * LCDHeight; i++)
+	{
+		output[i * 3] = (byte)(frame[i] >> 16);
+		output[i * 3 + 1] = (byte)(frame[i] >> 8);
+		output[i * 3 + 2] = (byte)frame[i];
+	}
+}
+
+int FrameDumpSink::TakeFreeSlot()
+{
+	int slot;
+	Backoff backoff;
+	while (!m_free.TryPop(&slot))
+	{
+		if (m_policy == FrameDumpPolicy::Drop)
+		{
+			return -1;
+		}
+
+		backoff.Wait();
+	}
+
+	return slot;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include "PCH.h"
+#include "LockFreeQueue.h"
+#include "VideoSink.h"
+
+enum class FrameDumpFormat : byte
+{
+	Y4M, // YUV4MPEG2, 4:2:0 with full range BT.601 colors. Tagged XCOLORRANGE=FULL, which ffmpeg honors; readers that ignore the tag show it with crushed blacks and whites
+	RawRGB, // RGB24 frames one after the other, with no header. Read with -f rawvideo -pix_fmt rgb24 -s 160x144 -r 59.73
+
+	Count
+};
+
+/** What Present does when the writer is a whole queue behind */
+enum class FrameDumpPolicy : byte
+{
+	Block, // Wait for a free slot. Every frame is written, the emulation slows down to the speed of the disk
+	Drop, // Drop the frame and count it. The emulation never waits
+
+	Count
+};
+
+/**
+* Records the presented frames to a file, or to a pipe into another program, on a thread of its own.
+* Present only copies the framebuffer into a free slot and passes the slot to the writer through a lock-free queue.
+* The conversion to the output format and the writes to the file happen on the writer thread.
+*/
+class FrameDumpSink : public VideoSink
+{
+public:
+	static const int DefaultSlotCount = 8;
+
+private:
+	FrameDumpFormat m_format;
+	FrameDumpPolicy m_policy;
+
+	std::FILE* m_file;
+	bool m_isPipe;
+
+	std::unique_ptr<uint[]> m_frames; // The slots, a LCDWidth x LCDHeight frame each
+	std::unique_ptr<byte[]> m_output; // The converted frame. Writer thread only
+	size_t m_outputSize;
+
+	// The slots travel between the threads as their indices
+	SPSCQueue<int> m_filled; // To be written. -1 stops the writer
+	SPSCQueue<int> m_free; // Written, returned by the writer
+
+	ulonglong m_frameCount; // Presented, the dropped frames included
+	ulonglong m_droppedCount;
+	std::atomic<ulonglong> m_writtenCount;
+	std::atomic<bool> m_hasWriteFailed;
+
+	std::thread m_thread;
+
+public:
+	/**
+	* Write the frames to path. A path that starts with | is a command that gets the frames on its standard input.
+	* slotCount is the number of frames that can wait for the writer, a power of two.
+	*/
+	FrameDumpSink(const char* path, FrameDumpFormat format, FrameDumpPolicy policy, int slotCount = DefaultSlotCount);
+
+	virtual ~FrameDumpSink();
+
+	FrameDumpSink(const FrameDumpSink&) = delete;
+	FrameDumpSink& operator=(const FrameDumpSink&) = delete;
+
+	/** Whether the file or the pipe could be opened. A sink that isn't open ignores the frames */
+	bool IsOpen() const;
+
+	virtual void Present(const uint* framebuffer) override;
+
+	/** Write the frames that are still queued and close the file. The following frames are ignored */
+	void Close();
+
+	ulonglong GetFrameCount() const;
+	ulonglong GetDroppedCount() const;
+	ulonglong GetWrittenCount() const;
+
+	/** Whether a write to the file failed, because the disk is full or the program at the end of the pipe quit */
+	bool HasWriteFailed() const;
+
+	/** The format with the name, "y4m" or "raw". Count if there is no such format */
+	static FrameDumpFormat GetFormat(const char* name);
+
+private:
+	void Run();
+
+	void WriteHeader();
+	void Write(const uint* frame);
+
+	void ConvertToY4M(const uint* frame);
+	void ConvertToRGB(const uint* frame);
+
+	/** Take a free slot. Waits for one with the Block policy. -1 if the frame is dropped */
+	int TakeFreeSlot();
+};
@@ -0,0 +1,260 @@
+#include <cstring>
+#include "FrameHash.h"
+#include "CPUFeatures.h"
+
+#if HAS_X86_SIMD
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+static const int LaneCount = 8;
+static const size_t StripeSize = LaneCount * sizeof(ulonglong); // The bytes that go into the lanes at once
+static const int StripesPerBlock = 16;
+static const size_t BlockSize = StripeSize * StripesPerBlock;
+
+// Every stripe of a block uses the key that starts one lane further, so a stripe gives different sums at different positions
+static const int KeyCount = LaneCount + StripesPerBlock;
+
+static const ulonglong Prime32 = 0x9E3779B1ULL;
+static const ulonglong Prime64_1 = 0x9E3779B185EBCA87ULL;
+static const ulonglong Prime64_2 = 0xC2B2AE3D27D4EB4FULL;
+static const ulonglong Prime64_3 = 0x165667B19E3779F9ULL;
+static const ulonglong Prime64_4 = 0x85EBCA77C2B2AE63ULL;
+
+struct Keys
+{
+	ulonglong values[KeyCount];
+};
+
+static Keys BuildKeys()
+{
+	// SplitMix64, so the keys have no structure
+	Keys keys;
+	ulonglong seed = Prime64_1;
+	for (int i = 0; i < KeyCount; i++)
+	{
+		seed += 0x9E3779B97F4A7C15ULL;
+		ulonglong value = seed;
+		value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+		keys.values[i] = value ^ (value >> 31);
+	}
+
+	return keys;
+}
+
+static const ulonglong* GetKeys()
+{
+	static const Keys keys = BuildKeys();
+	return keys.values;
+}
+
+static ulonglong Read64(const byte* data)
+{
+	ulonglong value;
+	std::memcpy(&value, data, sizeof(value));
+	return value;
+}
+
+static ulonglong Avalanche(ulonglong hash)
+{
+	hash ^= hash >> 33;
+	hash *= Prime64_2;
+	hash ^= hash >> 29;
+	hash *= Prime64_3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+static void AccumulateStripeScalar(ulonglong* lanes, const byte* stripe, const ulonglong* keys)
+{
+	for (int i = 0; i < LaneCount; i++)
+	{
+		ulonglong value = Read64(stripe + i * sizeof(ulonglong));
+		ulonglong keyed = value ^ keys[i];
+		lanes[i ^ 1] += value;
+		lanes[i] += (keyed & 0xFFFFFFFF) * (keyed >> 32);
+	}
+}
+
+static void ScrambleScalar(ulonglong* lanes, const ulonglong* keys)
+{
+	for (int i = 0; i < LaneCount; i++)
+	{
+		ulonglong lane = lanes[i];
+		lane ^= lane >> 47;
+		lane ^= keys[i];
+		lanes[i] = lane * Prime32;
+	}
+}
+
+#if HAS_X86_SIMD
+// The same as the scalar version, 2 lanes per register
+static void AccumulateBlocksSSE2(ulonglong* lanes, const byte* data, size_t blockCount, const ulonglong* keys)
+{
+	__m128i accumulators[LaneCount / 2];
+	for (int i = 0; i < LaneCount / 2; i++)
+	{
+		accumulators[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lanes + i * 2));
+	}
+
+	const __m128i prime = _mm_set1_epi32((int)Prime32);
+	for (size_t block = 0; block < blockCount; block++)
+	{
+		for (int stripe = 0; stripe < StripesPerBlock; stripe++)
+		{
+			const byte* stripeData = data + block * BlockSize + stripe * StripeSize;
+			for (int i = 0; i < LaneCount / 2; i++)
+			{
+				__m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(stripeData) + i);
+				__m128i key = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + stripe + i * 2));
+				__m128i keyed = _mm_xor_si128(value, key);
+
+				// The low half of each lane times its high half
+				__m128i product = _mm_mul_epu32(keyed, _mm_shuffle_epi32(keyed, _MM_SHUFFLE(2, 3, 0, 1)));
+				__m128i swapped = _mm_shuffle_epi32(value, _MM_SHUFFLE(1, 0, 3, 2));
+				accumulators[i] = _mm_add_epi64(accumulators[i], _mm_add_epi64(product, swapped));
+			}
+		}
+
+		// A 64 bit lane times a 32 bit prime, from the two halves of the lane
+		for (int i = 0; i < LaneCount / 2; i++)
+		{
+			__m128i lane = accumulators[i];
+			lane = _mm_xor_si128(lane, _mm_srli_epi64(lane, 47));
+			lane = _mm_xor_si128(lane, _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + StripesPerBlock + i * 2)));
+
+			__m128i low = _mm_mul_epu32(lane, prime);
+			__m128i high = _mm_slli_epi64(_mm_mul_epu32(_mm_srli_epi64(lane, 32), prime), 32);
+			accumulators[i] = _mm_add_epi64(low, high);
+		}
+	}
+
+	for (int i = 0; i < LaneCount / 2; i++)
+	{
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes + i * 2), accumulators[i]);
+	}
+}
+
+// The SSE2 version on 4 lanes per register
+TARGET_AVX2 static void AccumulateBlocksAVX2(ulonglong* lanes, const byte* data, size_t blockCount, const ulonglong* keys)
+{
+	__m256i accumulators[LaneCount / 4];
+	for (int i = 0; i < LaneCount / 4; i++)
+	{
+		accumulators[i] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lanes + i * 4));
+	}
+
+	const __m256i prime = _mm256_set1_epi32((int)Prime32);
+	for (size_t block = 0; block < blockCount; block++)
+	{
+		for (int stripe = 0; stripe < StripesPerBlock; stripe++)
+		{
+			const byte* stripeData = data + block * BlockSize + stripe * StripeSize;
+			for (int i = 0; i < LaneCount / 4; i++)
+			{
+				__m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(stripeData) + i);
+				__m256i key = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + stripe + i * 4));
+				__m256i keyed = _mm256_xor_si256(value, key);
+
+				__m256i product = _mm256_mul_epu32(keyed, _mm256_shuffle_epi32(keyed, _MM_SHUFFLE(2, 3, 0, 1)));
+				__m256i swapped = _mm256_shuffle_epi32(value, _MM_SHUFFLE(1, 0, 3, 2));
+				accumulators[i] = _mm256_add_epi64(accumulators[i], _mm256_add_epi64(product, swapped));
+			}
+		}
+
+		for (int i = 0; i < LaneCount / 4; i++)
+		{
+			__m256i lane = accumulators[i];
+			lane = _mm256_xor_si256(lane, _mm256_srli_epi64(lane, 47));
+			lane = _mm256_xor_si256(lane, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + StripesPerBlock + i * 4)));
+
+			__m256i low = _mm256_mul_epu32(lane, prime);
+			__m256i high = _mm256_slli_epi64(_mm256_mul_epu32(_mm256_srli_epi64(lane, 32), prime), 32);
+			accumulators[i] = _mm256_add_epi64(low, high);
+		}
+	}
+
+	for (int i = 0; i < LaneCount / 4; i++)
+	{
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes + i * 4), accumulators[i]);
+	}
+}
+#endif
+
+static void AccumulateBlocksScalar(ulonglong* lanes, const byte* data, size_t blockCount, const ulonglong* keys)
+{
+	for (size_t block = 0; block < blockCount; block++)
+	{
+		for (int stripe = 0; stripe < StripesPerBlock; stripe++)
+		{
+			AccumulateStripeScalar(lanes, data + block * BlockSize + stripe * StripeSize, keys + stripe);
+		}
+
+		ScrambleScalar(lanes, keys + StripesPerBlock);
+	}
+}
+
+static PixelKernelSet GetBestSet()
+{
+	const CPUFeatures& features = CPUFeatures::Get();
+	if (features.hasAVX2)
+	{
+		return PixelKernelSet::AVX2;
+	}
+
+	return features.hasSSE2 ? PixelKernelSet::SSE2 : PixelKernelSet::Scalar;
+}
+
+static ulonglong Hash(const byte* data, size_t size, PixelKernelSet set)
+{
+	const ulonglong* keys = GetKeys();
+	ulonglong lanes[LaneCount] = { Prime32, Prime64_1, Prime64_2, Prime64_3, Prime64_4, Prime64_1 ^ Prime64_2, Prime64_3 ^ Prime64_4, Prime32 ^ Prime64_1 };
+
+	size_t blockCount = size / BlockSize;
+	switch (set)
+	{
+#if HAS_X86_SIMD
+	case PixelKernelSet::AVX2:
+		AccumulateBlocksAVX2(lanes, data, blockCount, keys);
+		break;
+
+	case PixelKernelSet::SSE2:
+		AccumulateBlocksSSE2(lanes, data, blockCount, keys);
+		break;
+#endif
+
+	default:
+		AccumulateBlocksScalar(lanes, data, blockCount, keys);
+		break;
+	}
+
+	// The rest goes in whole stripes, the last one padded with zeros. The length at the end tells the padding apart
+	size_t offset = blockCount * BlockSize;
+	for (int stripe = 0; offset < size; stripe++, offset += StripeSize)
+	{
+		byte padded[StripeSize] = {};
+		std::memcpy(padded, data + offset, (size - offset < StripeSize) ? size - offset : StripeSize);
+		AccumulateStripeScalar(lanes, padded, keys + stripe);
+	}
+
+	ulonglong hash = size * Prime64_1;
+	for (int i = 0; i < LaneCount; i++)
+	{
+		hash ^= Avalanche(lanes[i] ^ keys[i]);
+		hash = ((hash << 27) | (hash >> 37)) * Prime64_1 + Prime64_4;
+	}
+
+	return Avalanche(hash);
+}
+
+ulonglong FrameHash::Compute(const byte* data, size_t size)
+{
+	static const PixelKernelSet set = GetBestSet();
+	return Hash(data, size, set);
+}
+
+ulonglong FrameHash::Compute(const byte* data, size_t size, PixelKernelSet set)
+{
+	return Hash(data, size, set);
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "PCH.h"
+#include "PixelKernels.h"
+
+/**
+* A fast 64 bit hash of a framebuffer, for comparing runs by their output. Not cryptographic.
+* The bytes are accumulated in 8 lanes of 64 bits with 32x32 bit multiplies, in the style of XXH3, which maps directly
+* to SSE2. The lanes are scrambled after every block, so the order of the bytes matters, and the lanes are merged and
+* avalanched at the end. The SIMD and the scalar implementations give the same hashes.
+* The instruction sets are the ones of the pixel kernels.
+*/
+namespace FrameHash
+{
+	/** Hash size bytes with the best instruction set of the CPU */
+	ulonglong Compute(const byte* data, size_t size);
+
+	/** Hash with a specific instruction set, which the CPU must support. Scalar is the reference */
+	ulonglong Compute(const byte* data, size_t size, PixelKernelSet set);
+}
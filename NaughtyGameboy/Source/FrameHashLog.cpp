@@ -0,0 +1,70 @@
+#include "FrameHashLog.h"
+#include "Logger.h"
+
+const char FrameHashLog::Magic[8] = { 'N', 'G', 'B', 'H', 'A', 'S', 'H', '1' };
+
+FrameHashLog::FrameHashLog(const char* path, bool isBinary) :
+	m_file(std::fopen(path, isBinary ? "wb" : "w")),
+	m_isBinary(isBinary),
+	m_count(0)
+{
+	if (m_file == nullptr)
+	{
+		Logger::LogError("Frame hash log %s could not be opened", path);
+		return;
+	}
+
+	if (m_isBinary)
+	{
+		std::fwrite(Magic, 1, sizeof(Magic), m_file);
+	}
+}
+
+FrameHashLog::~FrameHashLog()
+{
+	if (m_file != nullptr)
+	{
+		std::fclose(m_file);
+	}
+}
+
+bool FrameHashLog::IsOpen() const
+{
+	return m_file != nullptr;
+}
+
+void FrameHashLog::Add(ulong frame, ulonglong hash)
+{
+	if (m_file == nullptr)
+	{
+		return;
+	}
+
+	if (m_isBinary)
+	{
+		// Byte by byte, so the log is the same on any host
+		byte record[12];
+		for (int i = 0; i < 4; i++)
+		{
+			record[i] = (byte)(frame >> (i * 8));
+		}
+
+		for (int i = 0; i < 8; i++)
+		{
+			record[4 + i] = (byte)(hash >> (i * 8));
+		}
+
+		std::fwrite(record, 1, sizeof(record), m_file);
+	}
+	else
+	{
+		std::fprintf(m_file, "%lu %016llx\n", frame, hash);
+	}
+
+	m_count++;
+}
+
+ulonglong FrameHashLog::GetCount() const
+{
+	return m_count;
+}
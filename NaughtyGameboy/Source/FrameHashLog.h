@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdio>
+#include "PCH.h"
+
+/**
+* A per run log of the frame hashes, to compare runs without storing their video. Either text, a line of
+* "<frame> <hash in hex>" per frame that diff can compare, or binary: the Magic, then 12 bytes per frame,
+* the frame number in 32 bits and the hash in 64 bits, both little endian.
+*/
+class FrameHashLog
+{
+public:
+	static const char Magic[8];
+
+private:
+	std::FILE* m_file;
+	bool m_isBinary;
+	ulonglong m_count;
+
+public:
+	FrameHashLog(const char* path, bool isBinary);
+	~FrameHashLog();
+
+	FrameHashLog(const FrameHashLog&) = delete;
+	FrameHashLog& operator=(const FrameHashLog&) = delete;
+
+	bool IsOpen() const;
+
+	void Add(ulong frame, ulonglong hash);
+
+	ulonglong GetCount() const;
+};
@@ -0,0 +1,49 @@
+#include "FrameSkipper.h"
+
+const double FrameSkipper::FrameMilliseconds = 70224.0 * 1000.0 / 4194304.0;
+
+FrameSkipper::FrameSkipper(int skip, bool isAuto) :
+	m_isAuto(isAuto),
+	m_skip((skip > 0) ? skip : 0),
+	m_skippedCount(0),
+	m_lagMilliseconds(0.0)
+{
+}
+
+bool FrameSkipper::ShouldRender() const
+{
+	if (!m_isAuto)
+	{
+		return m_skippedCount >= m_skip;
+	}
+
+	// Skip while more than a frame behind. A skipped frame is cheaper than the Game Boy frame time, so the lag shrinks
+	return m_lagMilliseconds < FrameMilliseconds || m_skippedCount >= MaxAutoSkip;
+}
+
+void FrameSkipper::EndFrame(bool isRendered, double hostMilliseconds)
+{
+	m_skippedCount = isRendered ? 0 : m_skippedCount + 1;
+
+	m_lagMilliseconds += hostMilliseconds - FrameMilliseconds;
+	if (m_lagMilliseconds < 0.0)
+	{
+		// Running ahead is covered by the vsync wait. It doesn't buy skipped frames later
+		m_lagMilliseconds = 0.0;
+	}
+	else if (m_lagMilliseconds > FrameMilliseconds * MaxAutoSkip)
+	{
+		// Far behind, e.g. after the window was dragged. Don't keep skipping to catch up with it
+		m_lagMilliseconds = FrameMilliseconds * MaxAutoSkip;
+	}
+}
+
+int FrameSkipper::GetSkip() const
+{
+	return m_skip;
+}
+
+bool FrameSkipper::IsAuto() const
+{
+	return m_isAuto;
+}
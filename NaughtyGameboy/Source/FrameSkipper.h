@@ -0,0 +1,33 @@
+#pragma once
+
+#include "PCH.h"
+
+/**
+* Decides which frames get drawn. Either draws one frame out of every skip + 1, or in automatic mode skips frames
+* while the host is slower than the Game Boy, so the emulation keeps its speed and only the picture gets choppy.
+*/
+class FrameSkipper
+{
+public:
+	static const double FrameMilliseconds; // 70224 cycles at 4.194304 MHz
+	static const int MaxAutoSkip = 4; // Consecutive frames that automatic mode can skip, so the picture never freezes
+
+private:
+	bool m_isAuto;
+	int m_skip;
+	int m_skippedCount; // Frames skipped in a row
+	double m_lagMilliseconds; // How far the host is behind the Game Boy in automatic mode
+
+public:
+	/** Draws one frame out of every skip + 1. Automatic mode ignores skip */
+	FrameSkipper(int skip, bool isAuto);
+
+	/** Whether the next frame should be drawn */
+	bool ShouldRender() const;
+
+	/** Called after each frame with the time the host spent on it, drawing and presenting included */
+	void EndFrame(bool isRendered, double hostMilliseconds);
+
+	int GetSkip() const;
+	bool IsAuto() const;
+};
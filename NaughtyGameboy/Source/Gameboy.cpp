@@ -0,0 +1,80 @@
+#include <cstring>
+#include "Gameboy.h"
+#include "Logger.h"
+
+const size_t Gameboy::StateSize =
+	StateArena::GetAllocationSize(sizeof(Scheduler::State)) +
+	StateArena::GetAllocationSize(sizeof(MMU::Memory)) +
+	StateArena::GetAllocationSize(sizeof(MMU::State)) +
+	StateArena::GetAllocationSize(sizeof(CPU::State)) +
+	StateArena::GetAllocationSize(sizeof(PPU::State)) +
+	StateArena::GetAllocationSize(sizeof(PixelFIFORenderer::State));
+
+Gameboy::Gameboy(bool isCGB /*= false*/, PPUBackend ppuBackend /*= PPUBackend::Scanline*/) :
+	m_arena(StateSize),
+	m_scheduler(&m_arena)
+{
+	m_MMU = std::make_unique<MMU>(&m_scheduler, &m_arena, isCGB);
+	m_CPU = std::make_unique<CPU>(m_MMU.get(), &m_arena);
+	m_PPU = std::make_unique<PPU>(m_MMU.get(), &m_scheduler, &m_arena, ppuBackend);
+
+	// The arena is rounded up to whole pages, so a state missing from the sum can still fit. The sizes have to match exactly
+	if (m_arena.GetSize() != StateSize)
+	{
+		Logger::LogError("The state size is %u bytes, but %u bytes were allocated", (unsigned int)StateSize, (unsigned int)m_arena.GetSize());
+	}
+}
+
+ulong Gameboy::Step()
+{
+	ulong cycles = m_CPU->Step();
+
+	// The CPU is halted while a CGB DMA is transferring
+	cycles += m_MMU->TakeDMAStallCycles();
+
+	m_scheduler.AddCycles(cycles);
+
+	// An HBlank DMA block starts inside AddCycles, and its stall has to pass before the next instruction.
+	// The stall can reach the next HBlank, so this goes on until no new stall comes up
+	for (ulong stallCycles = m_MMU->TakeDMAStallCycles(); stallCycles > 0; stallCycles = m_MMU->TakeDMAStallCycles())
+	{
+		m_scheduler.AddCycles(stallCycles);
+		cycles += stallCycles;
+	}
+
+	return cycles;
+}
+
+size_t Gameboy::GetStateSize() const
+{
+	return m_arena.GetSize();
+}
+
+void Gameboy::SaveState(byte* buffer) const
+{
+	std::memcpy(buffer, m_arena.GetData(), m_arena.GetSize());
+}
+
+void Gameboy::LoadState(const byte* buffer)
+{
+	std::memcpy(m_arena.GetData(), buffer, m_arena.GetSize());
+
+	// The pointers into the state are not part of it
+	m_MMU->OnStateLoaded();
+	m_PPU->OnStateLoaded();
+}
+
+MMU* Gameboy::GetMMU()
+{
+	return m_MMU.get();
+}
+
+PPU* Gameboy::GetPPU()
+{
+	return m_PPU.get();
+}
+
+Scheduler* Gameboy::GetScheduler()
+{
+	return &m_scheduler;
+}
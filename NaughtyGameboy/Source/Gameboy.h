@@ -0,0 +1,44 @@
+#pragma once
+
+#include "PCH.h"
+#include "CPU.h"
+#include "MMU.h"
+#include "PPU.h"
+#include "Scheduler.h"
+#include "StateArena.h"
+
+/** The whole machine. Owns the subsystems and keeps them in sync with the CPU */
+class Gameboy
+{
+private:
+	// The size of the state of all the subsystems. A new subsystem has to add its state here
+	static const size_t StateSize;
+
+private:
+	StateArena m_arena; // Must be constructed before the subsystems, since they allocate their state from it
+	Scheduler m_scheduler;
+	std::unique_ptr<MMU> m_MMU;
+	std::unique_ptr<CPU> m_CPU;
+	std::unique_ptr<PPU> m_PPU;
+
+public:
+	Gameboy(bool isCGB = false, PPUBackend ppuBackend = PPUBackend::Scanline);
+	Gameboy(const Gameboy&) = delete;
+	Gameboy& operator=(const Gameboy&) = delete;
+
+	/** Execute 1 CPU instruction and run the hardware events that became due. Returns the number of cycles that passed */
+	ulong Step();
+
+	/** The number of bytes a snapshot of the machine takes */
+	size_t GetStateSize() const;
+
+	/** Copy the whole machine state to buffer, which must be GetStateSize() bytes */
+	void SaveState(byte* buffer) const;
+
+	/** Restore a state saved by SaveState. The state can come from any instance with the same hardware model */
+	void LoadState(const byte* buffer);
+
+	MMU* GetMMU();
+	PPU* GetPPU();
+	Scheduler* GetScheduler();
+};
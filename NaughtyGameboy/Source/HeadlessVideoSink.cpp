@@ -0,0 +1,29 @@
+#include "HeadlessVideoSink.h"
+
+HeadlessVideoSink::HeadlessVideoSink(bool isKeepingFrames) :
+	m_isKeepingFrames(isKeepingFrames),
+	m_framebuffer(nullptr),
+	m_frameCount(0)
+{
+}
+
+void HeadlessVideoSink::Present(const uint* framebuffer)
+{
+	// The framebuffer belongs to the PPU and stays valid, so it's enough to keep the pointer
+	if (m_isKeepingFrames)
+	{
+		m_framebuffer = framebuffer;
+	}
+
+	m_frameCount++;
+}
+
+const uint* HeadlessVideoSink::GetFramebuffer() const
+{
+	return m_framebuffer;
+}
+
+ulonglong HeadlessVideoSink::GetFrameCount() const
+{
+	return m_frameCount;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "PCH.h"
+#include "VideoSink.h"
+
+/** A video sink without a display, for running many instances on a server. Doesn't depend on SDL */
+class HeadlessVideoSink : public VideoSink
+{
+private:
+	bool m_isKeepingFrames;
+	const uint* m_framebuffer;
+	ulonglong m_frameCount;
+
+public:
+	/** With isKeepingFrames the sink remembers the last framebuffer, otherwise the frames are only counted */
+	HeadlessVideoSink(bool isKeepingFrames);
+
+	virtual void Present(const uint* framebuffer) override;
+
+	/** The framebuffer of the last frame. Null if the sink discards the frames or no frame was presented yet */
+	const uint* GetFramebuffer() const;
+
+	ulonglong GetFrameCount() const;
+};
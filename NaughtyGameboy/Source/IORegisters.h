@@ -0,0 +1,63 @@
+#pragma once
+
+#include "PCH.h"
+
+// Addresses of the memory mapped IO registers (0xFF00-0xFF7F) and the interrupt enable register (0xFFFF)
+namespace IO
+{
+	// Joypad and serial
+	const ushort JOYP = 0xFF00; // Joypad
+	const ushort SB = 0xFF01; // Serial transfer data
+	const ushort SC = 0xFF02; // Serial transfer control
+
+	// Timer
+	const ushort DIV = 0xFF04; // Divider
+	const ushort TIMA = 0xFF05; // Timer counter
+	const ushort TMA = 0xFF06; // Timer modulo
+	const ushort TAC = 0xFF07; // Timer control
+
+	// Interrupts
+	const ushort IF = 0xFF0F; // Interrupt flags
+	const ushort IE = 0xFFFF; // Interrupt enable
+
+	// Interrupt bits in IF and IE. The lower bit has the higher priority
+	const byte VBlankInterrupt = 0;
+	const byte LCDStatInterrupt = 1;
+	const byte TimerInterrupt = 2;
+	const byte SerialInterrupt = 3;
+	const byte JoypadInterrupt = 4;
+
+	// Sound
+	const ushort NR10 = 0xFF10;
+	const ushort NR52 = 0xFF26; // Sound on/off
+	const ushort WaveRAMStart = 0xFF30;
+	const ushort WaveRAMEnd = 0xFF3F;
+
+	// LCD
+	const ushort LCDC = 0xFF40; // LCD control
+	const ushort STAT = 0xFF41; // LCD status
+	const ushort SCY = 0xFF42; // Scroll Y
+	const ushort SCX = 0xFF43; // Scroll X
+	const ushort LY = 0xFF44; // LCD Y coordinate
+	const ushort LYC = 0xFF45; // LY compare
+	const ushort DMA = 0xFF46; // OAM DMA source address
+	const ushort BGP = 0xFF47; // Background palette (DMG)
+	const ushort OBP0 = 0xFF48; // Object palette 0 (DMG)
+	const ushort OBP1 = 0xFF49; // Object palette 1 (DMG)
+	const ushort WY = 0xFF4A; // Window Y position
+	const ushort WX = 0xFF4B; // Window X position + 7
+
+	// CGB only
+	const ushort KEY1 = 0xFF4D; // Speed switch
+	const ushort VBK = 0xFF4F; // VRAM bank
+	const ushort HDMA1 = 0xFF51; // HDMA source high
+	const ushort HDMA2 = 0xFF52; // HDMA source low
+	const ushort HDMA3 = 0xFF53; // HDMA destination high
+	const ushort HDMA4 = 0xFF54; // HDMA destination low
+	const ushort HDMA5 = 0xFF55; // HDMA length/mode/start
+	const ushort BCPS = 0xFF68; // Background palette index
+	const ushort BCPD = 0xFF69; // Background palette data
+	const ushort OCPS = 0xFF6A; // Object palette index
+	const ushort OCPD = 0xFF6B; // Object palette data
+	const ushort SVBK = 0xFF70; // WRAM bank
+}
@@ -1,13 +1,29 @@
+#ifndef HEADLESS_BUILD
+
+#include <cstring>
 #include <SDL.h>
+#include "PCH.h"
 #include "LCD.h"
 #include "Logger.h"
+#include "PPURegisters.h"
+#include "ScalerThread.h"
 
 LCD::LCD() :
 	m_initialized(false),
 	m_width(0),
 	m_height(0),
 	m_window(nullptr),
-	m_surface(nullptr)
+	m_renderer(nullptr),
+	m_texture(nullptr),
+	m_textureWidth(0),
+	m_textureHeight(0),
+	m_presentTicks(0),
+	m_presentCount(0)
+{
+}
+
+// Here and not in the header, where ScalerThread is incomplete
+LCD::~LCD()
 {
 }
 
@@ -32,45 +48,213 @@ void LCD::Deinit()
 	}
 }
 
-void LCD::CreateWindow(int width, int height)
+void LCD::CreateWindow(int width, int height, bool isSoftwareRenderer /*= false*/)
 {
-	int horizontalPixelSize = width / 160;
-	int verticalPixelSize = height / 144;
-	if (horizontalPixelSize != verticalPixelSize || !IsPowerOfTwo(horizontalPixelSize) || !IsPowerOfTwo(verticalPixelSize))
-	{
-		Logger::LogError("Invalid screen m_width(%d) and m_height(%d)", width, height);
-		return;
-	}
-
 	m_width = width;
 	m_height = height;
-	m_pixelSize = horizontalPixelSize;
 
-	m_window = SDL_CreateWindow("NaughtyGameboy", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, m_width, m_height, SDL_WINDOW_SHOWN);
+	m_window = SDL_CreateWindow("NaughtyGameboy", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, m_width, m_height, SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
 	if (m_window == nullptr)
 	{
 		Logger::LogError("Window could not be created! SDL_Error: %s", SDL_GetError());
+		return;
 	}
-	else
+
+	Uint32 rendererFlags = isSoftwareRenderer ? SDL_RENDERER_SOFTWARE : (SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+	m_renderer = SDL_CreateRenderer(m_window, -1, rendererFlags);
+	if (m_renderer == nullptr)
 	{
-		m_surface = SDL_GetWindowSurface(m_window);
-		SDL_FillRect(m_surface, nullptr, SDL_MapRGB(m_surface->format, 0x00, 0x00, 0x00));
-		SDL_UpdateWindowSurface(m_window);
+		Logger::LogError("Renderer could not be created! SDL_Error: %s", SDL_GetError());
+		DestroyWindow();
+		return;
 	}
+
+	// Sharp pixels at any scale. The renderer scales the picture and adds the black bars
+	SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "nearest");
+	if (!CreateTexture(LCDWidth, LCDHeight))
+	{
+		DestroyWindow();
+		return;
+	}
+
+	SDL_SetRenderDrawColor(m_renderer, 0x00, 0x00, 0x00, 0xFF);
+	SDL_RenderClear(m_renderer);
+	SDL_RenderPresent(m_renderer);
 }
 
 void LCD::DestroyWindow()
 {
+	StopScaler();
+
+	if (m_texture != nullptr)
+	{
+		SDL_DestroyTexture(m_texture);
+		m_texture = nullptr;
+		m_textureWidth = 0;
+		m_textureHeight = 0;
+	}
+
+	if (m_renderer != nullptr)
+	{
+		SDL_DestroyRenderer(m_renderer);
+		m_renderer = nullptr;
+	}
+
 	if (m_window != nullptr)
 	{
 		SDL_DestroyWindow(m_window);
 		m_window = nullptr;
-		m_surface = nullptr;
 	}
 }
 
-bool LCD::IsPowerOfTwo(int number)
+void LCD::SetScaleFilter(ScaleFilter filter)
 {
-	bool isPowerOfTwo = (number != 0) && ((number & (number - 1)) == 0);
-	return isPowerOfTwo;
+	if (m_renderer == nullptr)
+	{
+		return;
+	}
+
+	StopScaler();
+	if (filter != ScaleFilter::None)
+	{
+		m_scaler = std::make_unique<ScalerThread>(filter);
+	}
+
+	int factor = Scalers::GetFactor(filter);
+	if (!CreateTexture(LCDWidth * factor, LCDHeight * factor))
+	{
+		DestroyWindow();
+	}
+}
+
+void LCD::Present(const uint* framebuffer)
+{
+	if (m_texture == nullptr)
+	{
+		return;
+	}
+
+	Uint64 start = SDL_GetPerformanceCounter();
+
+	// A scaled frame is uploaded when the scaler has one ready, usually the frame submitted the last time.
+	// Until then the texture keeps the previous one
+	if (m_scaler != nullptr)
+	{
+		m_scaler->Submit(framebuffer);
+		const uint* scaledFrame = m_scaler->TakeScaledFrame();
+		if (scaledFrame != nullptr)
+		{
+			Upload(scaledFrame, m_scaler->GetWidth(), m_scaler->GetHeight());
+		}
+	}
+	else
+	{
+		Upload(framebuffer, LCDWidth, LCDHeight);
+	}
+
+	Show(start);
 }
+
+void LCD::PresentPicture(const uint* picture, int width, int height)
+{
+	if (m_renderer == nullptr)
+	{
+		return;
+	}
+
+	Uint64 start = SDL_GetPerformanceCounter();
+
+	if ((width != m_textureWidth || height != m_textureHeight) && !CreateTexture(width, height))
+	{
+		DestroyWindow();
+		return;
+	}
+
+	Upload(picture, width, height);
+	Show(start);
+}
+
+void LCD::Upload(const uint* frame, int width, int height)
+{
+	// The frame is copied straight into the texture memory. There is no intermediate surface
+	void* pixels;
+	int pitch;
+	if (SDL_LockTexture(m_texture, nullptr, &pixels, &pitch) == 0)
+	{
+		const int rowSize = width * sizeof(uint);
+		if (pitch == rowSize)
+		{
+			std::memcpy(pixels, frame, rowSize * height);
+		}
+		else
+		{
+			for (int y = 0; y < height; y++)
+			{
+				std::memcpy(static_cast<byte*>(pixels) + y * pitch, frame + y * width, rowSize);
+			}
+		}
+
+		SDL_UnlockTexture(m_texture);
+	}
+}
+
+bool LCD::CreateTexture(int width, int height)
+{
+	if (m_texture != nullptr)
+	{
+		SDL_DestroyTexture(m_texture);
+	}
+
+	// The logical size follows the texture, so a scaled frame still maps to whole window pixels
+	SDL_RenderSetLogicalSize(m_renderer, width, height);
+
+	m_texture = SDL_CreateTexture(m_renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, width, height);
+	if (m_texture == nullptr)
+	{
+		Logger::LogError("Texture could not be created! SDL_Error: %s", SDL_GetError());
+		return false;
+	}
+
+	m_textureWidth = width;
+	m_textureHeight = height;
+
+	return true;
+}
+
+void LCD::Show(ulonglong start)
+{
+	SDL_RenderClear(m_renderer);
+	SDL_RenderCopy(m_renderer, m_texture, nullptr, nullptr);
+	SDL_RenderPresent(m_renderer);
+
+	m_presentTicks += SDL_GetPerformanceCounter() - start;
+	m_presentCount++;
+}
+
+void LCD::StopScaler()
+{
+	if (m_scaler == nullptr)
+	{
+		return;
+	}
+
+	// The presentation never waits for the scaler. A filter that is too slow for the frame rate shows up here
+	if (m_scaler->GetDroppedCount() > 0)
+	{
+		Logger::Log("Scaler: %llu frames dropped", m_scaler->GetDroppedCount());
+	}
+
+	m_scaler.reset();
+}
+
+double LCD::GetAveragePresentTime() const
+{
+	if (m_presentCount == 0)
+	{
+		return 0.0;
+	}
+
+	return (double)m_presentTicks / m_presentCount * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+#endif // HEADLESS_BUILD
@@ -1,23 +1,65 @@
 #pragma once
 
-class LCD
+#include "Scalers.h"
+#include "VideoSink.h"
+
+class ScalerThread;
+
+/** The SDL window */
+class LCD : public VideoSink
 {
 public:
 	LCD();
+	~LCD();
 
 	void Init();
 	void Deinit();
 
-	void CreateWindow(int width, int height);
+	/** Create a resizable window. Any size works, the picture is scaled to fit with its aspect ratio kept */
+	void CreateWindow(int width, int height, bool isSoftwareRenderer = false);
 	void DestroyWindow();
 
+	/**
+	* Scale the frames with filter before they are uploaded, on a thread of its own. None uploads the frames as they are.
+	* Call after CreateWindow.
+	*/
+	void SetScaleFilter(ScaleFilter filter);
+
+	/** Upload a LCDWidth x LCDHeight ARGB8888 framebuffer and show it */
+	virtual void Present(const uint* framebuffer) override;
+
+	/** Upload a width x height ARGB8888 picture of any size and show it, like the thumbnail grid. Doesn't go through the scale filter */
+	void PresentPicture(const uint* picture, int width, int height);
+
+	/** The average time Present took, in milliseconds. Includes the wait for the vertical sync on the accelerated renderer */
+	double GetAveragePresentTime() const;
+
+private:
+	/** Copy a width x height frame into the texture, which must be the same size */
+	void Upload(const uint* frame, int width, int height);
+
+	/** (Re)create the texture for width x height frames */
+	bool CreateTexture(int width, int height);
+
+	/** Show the texture and count the time since start */
+	void Show(ulonglong start);
+
+	/** Stop the scaler thread, if there is one, and log the frames it dropped */
+	void StopScaler();
+
 private:
 	bool m_initialized;
 	int m_width;
 	int m_height;
-	int m_pixelSize;
 	SDL_Window* m_window;
-	SDL_Surface* m_surface;
+	SDL_Renderer* m_renderer;
+	SDL_Texture* m_texture; // Streaming texture the framebuffer is uploaded to every frame
+	int m_textureWidth;
+	int m_textureHeight;
+
+	std::unique_ptr<ScalerThread> m_scaler; // Null when the frames aren't scaled
 
-	bool IsPowerOfTwo(int number);
+	// Profiling counters
+	ulonglong m_presentTicks;
+	ulonglong m_presentCount;
 };
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "PCH.h"
+
+/**
+* A bounded queue for exactly one producer thread and one consumer thread. Neither side ever takes a lock.
+* The capacity must be a power of two.
+*/
+template<typename T>
+class SPSCQueue
+{
+private:
+	static const size_t CacheLineSize = 64;
+
+	std::unique_ptr<T[]> m_items;
+	size_t m_mask;
+
+	// The indices only grow. The producer and the consumer each write one of them, on separate cache lines
+	std::atomic<size_t> m_head; // The next item to pop
+	byte m_headPadding[CacheLineSize - sizeof(std::atomic<size_t>)];
+	std::atomic<size_t> m_tail; // The next free slot
+	byte m_tailPadding[CacheLineSize - sizeof(std::atomic<size_t>)];
+
+public:
+	explicit SPSCQueue(size_t capacity);
+
+	SPSCQueue(const SPSCQueue&) = delete;
+	SPSCQueue& operator=(const SPSCQueue&) = delete;
+
+	/** Producer only. Returns false if the queue is full */
+	bool TryPush(const T& item);
+
+	/** Consumer only. Returns false if the queue is empty */
+	bool TryPop(T* item);
+
+	/** The number of items in the queue. Exact only when called from one of the two threads while the other one is idle */
+	size_t GetSize() const;
+
+	size_t GetCapacity() const;
+};
+
+/**
+* How a thread waits on an empty or full queue. It yields at first, and sleeps between the polls once it has
+* waited for a while, so an idle thread doesn't burn a core.
+*/
+class Backoff
+{
+private:
+	static const int SpinCount = 1000; // The polls that only yield
+
+	int m_polls;
+
+public:
+	Backoff();
+
+	/** Called after a poll that found nothing to do */
+	void Wait();
+
+	/** Called after a poll that found work. The next wait yields again */
+	void Reset();
+};
+
+template<typename T>
+SPSCQueue<T>::SPSCQueue(size_t capacity) :
+	m_items(new T[capacity]),
+	m_mask(capacity - 1),
+	m_head(0),
+	m_tail(0)
+{
+}
+
+template<typename T>
+bool SPSCQueue<T>::TryPush(const T& item)
+{
+	size_t tail = m_tail.load(std::memory_order_relaxed);
+	if (tail - m_head.load(std::memory_order_acquire) > m_mask)
+	{
+		return false;
+	}
+
+	m_items[tail & m_mask] = item;
+	m_tail.store(tail + 1, std::memory_order_release);
+
+	return true;
+}
+
+template<typename T>
+bool SPSCQueue<T>::TryPop(T* item)
+{
+	size_t head = m_head.load(std::memory_order_relaxed);
+	if (head == m_tail.load(std::memory_order_acquire))
+	{
+		return false;
+	}
+
+	*item = m_items[head & m_mask];
+	m_head.store(head + 1, std::memory_order_release);
+
+	return true;
+}
+
+template<typename T>
+size_t SPSCQueue<T>::GetSize() const
+{
+	return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+}
+
+template<typename T>
+size_t SPSCQueue<T>::GetCapacity() const
+{
+	return m_mask + 1;
+}
+
+inline Backoff::Backoff() :
+	m_polls(0)
+{
+}
+
+inline void Backoff::Wait()
+{
+	if (m_polls < SpinCount)
+	{
+		m_polls++;
+		std::this_thread::yield();
+	}
+	else
+	{
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+	}
+}
+
+inline void Backoff::Reset()
+{
+	m_polls = 0;
+}
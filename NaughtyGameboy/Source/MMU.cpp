@@ -1,22 +1,90 @@
+#include <cstring>
 #include "MMU.h"
 #include "BitUtil.h"
+#include "IORegisters.h"
+#include "Logger.h"
+#include "Scheduler.h"
+#include "StateArena.h"
 
-MMU::MMU()
+const ushort MMU::IORegistersStart = 0xFF00;
+const ushort MMU::IORegistersEnd = 0xFF80;
+
+const ushort MMU::VRAMStart = 0x8000;
+const ushort MMU::ExternalRAMStart = 0xA000;
+const ushort MMU::WRAMStart = 0xC000;
+const ushort MMU::EchoRAMStart = 0xE000;
+const ushort MMU::EchoRAMEnd = 0xFE00;
+const ushort MMU::OAMStart = 0xFE00;
+const ushort MMU::OAMSize = 0xA0;
+const ushort MMU::HRAMStart = 0xFF80;
+
+const ulong MMU::OAMDMACycles = 160 * 4;
+const ulong MMU::HDMABlockCycles = 8 * 4;
+const ushort MMU::HDMABlockSize = 0x10;
+
+MMU::MMU(Scheduler* scheduler, StateArena* arena, bool isCGB) :
+	m_memory(arena->Allocate<Memory>()),
+	m_state(arena->Allocate<State>()),
+	m_isCGB(isCGB),
+	m_scheduler(scheduler),
+	m_isAccuracyMode(false),
+	m_videoMemoryWriteHook(nullptr),
+	m_videoMemoryWriteContext(nullptr),
+	m_isOAMDirty(true)
 {
-	for (int i = 0; i < ARRAY_SIZE(m_memory); i++)
+	// The arena memory is zeroed. Only the non zero state needs to be set
+	m_state->wramBank = 1;
+
+	MapMemoryPages();
+	MarkAllTilesDirty();
+
+	m_ioRegisters = GetIORegisterTemplate(m_isCGB);
+	for (int i = 0; i < IORegisterCount; i++)
+	{
+		IORegisterHooks& hooks = m_ioRegisters.registers[i];
+		hooks.readContext = (hooks.read != nullptr) ? this : nullptr;
+		hooks.writeContext = (hooks.write != nullptr) ? this : nullptr;
+
+		// Unmapped registers always read back as 0xFF
+		if (IsUnmappedIORegister(IORegistersStart + i))
+		{
+			SetIORegister(IORegistersStart + i, 0xFF);
+		}
+	}
+
+	if (m_isCGB)
 	{
-		m_memory[i] = 0x00;
+		SetIORegister(IO::VBK, 0xFE);
+		SetIORegister(IO::SVBK, 0xF8);
 	}
+
+	ResetIOCounters();
+
+	m_scheduler->Register(SchedulerEvent::OAMDMAEnd, &MMU::OnOAMDMAEnd, this);
+	m_scheduler->Register(SchedulerEvent::HDMABlock, &MMU::OnHDMABlock, this);
 }
 
 byte MMU::ReadByte(ushort address)
 {
-	return m_memory[address];
+	const byte* page = m_readPages[address >> 8];
+	if (page != nullptr)
+	{
+		return page[address & 0xFF];
+	}
+
+	return ReadByteSlow(address);
 }
 
 void MMU::WriteByte(ushort address, byte value)
 {
-	m_memory[address] = value;
+	byte* page = m_writePages[address >> 8];
+	if (page != nullptr)
+	{
+		page[address & 0xFF] = value;
+		return;
+	}
+
+	WriteByteSlow(address, value);
 }
 
 ushort MMU::ReadUShort(ushort address)
@@ -38,3 +106,566 @@ void MMU::WriteUShort(ushort address, ushort value)
 	byte highByte = GetHighByte(value);
 	WriteByte(address + 1, highByte);
 }
+
+void MMU::RegisterIOReadHook(ushort address, IOReadHook hook, void* context)
+{
+	if (address < IORegistersStart || address >= IORegistersEnd)
+	{
+		Logger::LogError("Address 0x%04X is not an IO register", address);
+		return;
+	}
+
+	IORegisterHooks& hooks = m_ioRegisters.registers[address - IORegistersStart];
+	hooks.read = hook;
+	hooks.readContext = context;
+}
+
+void MMU::RegisterIOWriteHook(ushort address, IOWriteHook hook, void* context)
+{
+	if (address < IORegistersStart || address >= IORegistersEnd)
+	{
+		Logger::LogError("Address 0x%04X is not an IO register", address);
+		return;
+	}
+
+	IORegisterHooks& hooks = m_ioRegisters.registers[address - IORegistersStart];
+	hooks.write = hook;
+	hooks.writeContext = context;
+}
+
+void MMU::SetVideoMemoryWriteHook(VideoMemoryWriteHook hook, void* context)
+{
+	m_videoMemoryWriteHook = hook;
+	m_videoMemoryWriteContext = context;
+}
+
+byte MMU::GetIORegister(ushort address) const
+{
+	return m_memory->high[address & 0xFF];
+}
+
+void MMU::SetIORegister(ushort address, byte value)
+{
+	m_memory->high[address & 0xFF] = value;
+}
+
+void MMU::RequestInterrupt(byte interrupt)
+{
+	byte flags = GetIORegister(IO::IF);
+	SetIORegister(IO::IF, SET_BIT(flags, interrupt));
+}
+
+ulong MMU::GetIOReadCount(ushort address) const
+{
+	return m_ioReadCounts[(address - IORegistersStart) & (IORegisterCount - 1)];
+}
+
+ulong MMU::GetIOWriteCount(ushort address) const
+{
+	return m_ioWriteCounts[(address - IORegistersStart) & (IORegisterCount - 1)];
+}
+
+void MMU::ResetIOCounters()
+{
+	for (int i = 0; i < IORegisterCount; i++)
+	{
+		m_ioReadCounts[i] = 0;
+		m_ioWriteCounts[i] = 0;
+	}
+}
+
+void MMU::SetAccuracyMode(bool isAccuracyMode)
+{
+	m_isAccuracyMode = isAccuracyMode;
+}
+
+bool MMU::IsCGB() const
+{
+	return m_isCGB;
+}
+
+void MMU::OnHBlank()
+{
+	if (!m_state->isHBlankDMAActive)
+	{
+		return;
+	}
+
+	// The CPU is halted while the block is transferred. The block is copied when its transfer time is over
+	m_state->dmaStallCycles += HDMABlockCycles;
+	m_scheduler->Schedule(SchedulerEvent::HDMABlock, HDMABlockCycles);
+}
+
+ulong MMU::TakeDMAStallCycles()
+{
+	ulong cycles = m_state->dmaStallCycles;
+	m_state->dmaStallCycles = 0;
+
+	return cycles;
+}
+
+MMU::Memory* MMU::GetMemory()
+{
+	return m_memory;
+}
+
+uint* MMU::GetDirtyTiles()
+{
+	return m_dirtyTiles;
+}
+
+bool* MMU::GetOAMDirtyFlag()
+{
+	return &m_isOAMDirty;
+}
+
+void MMU::OnStateLoaded()
+{
+	MapMemoryPages();
+	MarkAllTilesDirty();
+	m_isOAMDirty = true;
+}
+
+byte MMU::ReadByteSlow(ushort address)
+{
+	if (address < IORegistersStart)
+	{
+		// Only the OAM DMA bus lock makes the reads of these pages go through the slow path
+		return 0xFF;
+	}
+
+	if (address < IORegistersEnd)
+	{
+		return ReadIORegister(address);
+	}
+
+	return m_memory->high[address & 0xFF];
+}
+
+void MMU::WriteByteSlow(ushort address, byte value)
+{
+	if (address < VRAMStart)
+	{
+		// On a cartridge these writes select the ROM and RAM banks of the MBC. There is no MBC yet, so they are dropped
+		// and the ROM image stays intact
+		return;
+	}
+
+	if (address >= VRAMStart && address < ExternalRAMStart)
+	{
+		if (!m_state->isBusLocked)
+		{
+			ushort offset = address - VRAMStart;
+			m_memory->vram[m_state->vramBank][offset] = value;
+			MarkTileDirty(m_state->vramBank, offset);
+
+			if (m_videoMemoryWriteHook != nullptr)
+			{
+				m_videoMemoryWriteHook(m_videoMemoryWriteContext, address, m_state->vramBank, value);
+			}
+		}
+
+		return;
+	}
+
+	if (address < IORegistersStart)
+	{
+		// Either the bus is locked by the OAM DMA, or it's the 0xFE page. The unusable region ignores writes
+		if (!m_state->isBusLocked && address >= OAMStart && address < OAMStart + OAMSize)
+		{
+			m_memory->oam[address - OAMStart] = value;
+			m_isOAMDirty = true;
+
+			if (m_videoMemoryWriteHook != nullptr)
+			{
+				m_videoMemoryWriteHook(m_videoMemoryWriteContext, address, 0, value);
+			}
+		}
+
+		return;
+	}
+
+	if (address < IORegistersEnd)
+	{
+		WriteIORegister(address, value);
+		return;
+	}
+
+	m_memory->high[address & 0xFF] = value;
+}
+
+byte MMU::ReadIORegister(ushort address)
+{
+	ushort index = address - IORegistersStart;
+	m_ioReadCounts[index]++;
+
+	const IORegisterHooks& hooks = m_ioRegisters.registers[index];
+	byte value = GetIORegister(address);
+	if (hooks.read != nullptr)
+	{
+		value = hooks.read(hooks.readContext, address, value);
+	}
+
+	return value;
+}
+
+void MMU::WriteIORegister(ushort address, byte value)
+{
+	ushort index = address - IORegistersStart;
+	m_ioWriteCounts[index]++;
+
+	const IORegisterHooks& hooks = m_ioRegisters.registers[index];
+	if (hooks.write != nullptr)
+	{
+		value = hooks.write(hooks.writeContext, address, value);
+	}
+
+	SetIORegister(address, value);
+}
+
+void MMU::MapMemoryPages()
+{
+	MapPages(0x0000, sizeof(m_memory->rom), m_memory->rom, nullptr); // The writes are MBC commands, not data
+	MapPages(VRAMStart, VRAMBankSize, m_memory->vram[m_state->vramBank], nullptr); // The writes mark the dirty tiles
+	MapPages(ExternalRAMStart, sizeof(m_memory->externalRAM), m_memory->externalRAM, m_memory->externalRAM);
+	MapPages(WRAMStart, WRAMBankSize, m_memory->wram[0], m_memory->wram[0]);
+	MapPages(WRAMStart + WRAMBankSize, WRAMBankSize, m_memory->wram[m_state->wramBank], m_memory->wram[m_state->wramBank]);
+
+	// OAM and the unusable region. The writes need to be checked
+	MapPages(OAMStart, PageSize, m_memory->oam, nullptr);
+
+	// IO registers, HRAM and IE always need the slow path
+	MapPages(IORegistersStart, PageSize, nullptr, nullptr);
+}
+
+void MMU::MapPages(ushort address, ushort size, byte* read, byte* write)
+{
+	const int echoPageOffset = (EchoRAMStart - WRAMStart) / PageSize;
+
+	for (int offset = 0; offset < size; offset += PageSize)
+	{
+		int page = (address + offset) / PageSize;
+		byte* readPage = (read != nullptr) ? read + offset : nullptr;
+		byte* writePage = (write != nullptr) ? write + offset : nullptr;
+
+		m_mappedReadPages[page] = readPage;
+		m_mappedWritePages[page] = writePage;
+		m_readPages[page] = m_state->isBusLocked ? nullptr : readPage;
+		m_writePages[page] = m_state->isBusLocked ? nullptr : writePage;
+
+		// WRAM is mirrored to the echo RAM
+		int echoPage = page + echoPageOffset;
+		if (page >= WRAMStart / PageSize && echoPage < EchoRAMEnd / PageSize)
+		{
+			m_mappedReadPages[echoPage] = readPage;
+			m_mappedWritePages[echoPage] = writePage;
+			m_readPages[echoPage] = m_state->isBusLocked ? nullptr : readPage;
+			m_writePages[echoPage] = m_state->isBusLocked ? nullptr : writePage;
+		}
+	}
+}
+
+void MMU::UpdatePageTables()
+{
+	for (int i = 0; i < PageCount; i++)
+	{
+		m_readPages[i] = m_state->isBusLocked ? nullptr : m_mappedReadPages[i];
+		m_writePages[i] = m_state->isBusLocked ? nullptr : m_mappedWritePages[i];
+	}
+}
+
+void MMU::SelectVRAMBank(byte bank)
+{
+	if (bank == m_state->vramBank)
+	{
+		return;
+	}
+
+	m_state->vramBank = bank;
+	MapPages(VRAMStart, VRAMBankSize, m_memory->vram[bank], nullptr);
+}
+
+void MMU::NotifyVideoMemoryWrite(ushort address, byte bank, const byte* data, ushort size)
+{
+	if (m_videoMemoryWriteHook == nullptr)
+	{
+		return;
+	}
+
+	for (ushort i = 0; i < size; i++)
+	{
+		m_videoMemoryWriteHook(m_videoMemoryWriteContext, address + i, bank, data[i]);
+	}
+}
+
+void MMU::MarkTileDirty(byte bank, ushort offset)
+{
+	int tile = offset / TileSize;
+	if (tile < TilesPerBank)
+	{
+		tile += bank * TilesPerBank;
+		m_dirtyTiles[tile / 32] |= 1u << (tile % 32);
+	}
+}
+
+void MMU::MarkAllTilesDirty()
+{
+	for (int i = 0; i < ARRAY_SIZE(m_dirtyTiles); i++)
+	{
+		m_dirtyTiles[i] = 0xFFFFFFFF;
+	}
+}
+
+void MMU::SelectWRAMBank(byte bank)
+{
+	if (bank == m_state->wramBank)
+	{
+		return;
+	}
+
+	m_state->wramBank = bank;
+	MapPages(WRAMStart + WRAMBankSize, WRAMBankSize, m_memory->wram[bank], m_memory->wram[bank]);
+}
+
+void MMU::StartOAMDMA(byte sourcePage)
+{
+	// Sources above 0xDFFF read the echo of WRAM. The echo pages are already mapped to WRAM, but 0xFE and 0xFF aren't
+	if (sourcePage >= (EchoRAMStart >> 8))
+	{
+		sourcePage -= (EchoRAMStart - WRAMStart) >> 8;
+	}
+
+	// The hardware copies 1 byte per M-cycle. The whole transfer is done at once instead.
+	// Only the bus lock is modelled over time, and only in accuracy mode
+	std::memcpy(m_memory->oam, m_mappedReadPages[sourcePage], OAMSize);
+	m_isOAMDirty = true;
+	NotifyVideoMemoryWrite(OAMStart, 0, m_memory->oam, OAMSize);
+
+	if (m_isAccuracyMode)
+	{
+		m_state->isBusLocked = true;
+		UpdatePageTables();
+		m_scheduler->Schedule(SchedulerEvent::OAMDMAEnd, OAMDMACycles);
+	}
+}
+
+byte MMU::StartHDMA(byte value)
+{
+	byte blocks = (value & 0x7F) + 1;
+
+	if (m_state->isHBlankDMAActive && !IS_BIT_SET(value, 7))
+	{
+		// Writing bit 7 = 0 during an HBlank DMA stops it
+		m_state->isHBlankDMAActive = false;
+		byte blocksLeft = m_state->hdmaBlocksLeft - 1;
+		return SET_BIT(blocksLeft, 7);
+	}
+
+	if (IS_BIT_SET(value, 7))
+	{
+		// HBlank DMA. One block is transferred at the start of every HBlank
+		m_state->isHBlankDMAActive = true;
+		m_state->hdmaBlocksLeft = blocks;
+
+		return blocks - 1;
+	}
+
+	// General purpose DMA. The CPU is halted until the whole transfer is done, and the blocks are copied one after
+	// the other in that time. The PPU events that fall into the transfer see the blocks that are done so far
+	m_state->isGeneralDMAActive = true;
+	m_state->hdmaBlocksLeft = blocks;
+	m_state->dmaStallCycles += blocks * HDMABlockCycles;
+	m_scheduler->Schedule(SchedulerEvent::HDMABlock, HDMABlockCycles);
+
+	return blocks - 1;
+}
+
+void MMU::CopyHDMABlock()
+{
+	// The source and destination are 16 byte aligned, so a block never crosses a page and covers exactly 1 tile
+	ushort offset = m_state->hdmaDestination & 0x1FF0;
+	byte* destination = &m_memory->vram[m_state->vramBank][offset];
+	MarkTileDirty(m_state->vramBank, offset);
+	const byte* sourcePage = m_mappedReadPages[m_state->hdmaSource >> 8];
+	if (sourcePage != nullptr)
+	{
+		std::memcpy(destination, sourcePage + (m_state->hdmaSource & 0xFF), HDMABlockSize);
+	}
+	else
+	{
+		for (int i = 0; i < HDMABlockSize; i++)
+		{
+			destination[i] = ReadByteSlow(m_state->hdmaSource + i);
+		}
+	}
+
+	NotifyVideoMemoryWrite(VRAMStart + offset, m_state->vramBank, destination, HDMABlockSize);
+
+	m_state->hdmaSource += HDMABlockSize;
+	m_state->hdmaDestination += HDMABlockSize;
+}
+
+const MMU::IORegisterTable& MMU::GetIORegisterTemplate(bool isCGB)
+{
+	static const IORegisterTable dmgTemplate = BuildIORegisterTemplate(false);
+	static const IORegisterTable cgbTemplate = BuildIORegisterTemplate(true);
+
+	return isCGB ? cgbTemplate : dmgTemplate;
+}
+
+MMU::IORegisterTable MMU::BuildIORegisterTemplate(bool isCGB)
+{
+	IORegisterTable table;
+	for (int i = 0; i < IORegisterCount; i++)
+	{
+		IORegisterHooks& hooks = table.registers[i];
+		hooks.read = nullptr;
+		hooks.readContext = nullptr;
+		hooks.write = IsUnmappedIORegister(IORegistersStart + i) ? &MMU::OnUnmappedWrite : nullptr;
+		hooks.writeContext = nullptr;
+	}
+
+	table.registers[IO::DIV - IORegistersStart].write = &MMU::OnDIVWrite;
+	table.registers[IO::IF - IORegistersStart].read = &MMU::OnIFRead;
+	table.registers[IO::DMA - IORegistersStart].write = &MMU::OnDMAWrite;
+
+	if (isCGB)
+	{
+		table.registers[IO::HDMA1 - IORegistersStart].write = &MMU::OnHDMAAddressWrite;
+		table.registers[IO::HDMA2 - IORegistersStart].write = &MMU::OnHDMAAddressWrite;
+		table.registers[IO::HDMA3 - IORegistersStart].write = &MMU::OnHDMAAddressWrite;
+		table.registers[IO::HDMA4 - IORegistersStart].write = &MMU::OnHDMAAddressWrite;
+		table.registers[IO::HDMA5 - IORegistersStart].write = &MMU::OnHDMA5Write;
+		table.registers[IO::VBK - IORegistersStart].write = &MMU::OnVBKWrite;
+		table.registers[IO::SVBK - IORegistersStart].write = &MMU::OnSVBKWrite;
+	}
+
+	return table;
+}
+
+bool MMU::IsUnmappedIORegister(ushort address)
+{
+	// Registers that don't exist on the DMG. The CGB registers are mapped by their subsystems
+	return (address == 0xFF03) ||
+		(address >= 0xFF08 && address <= 0xFF0E) ||
+		(address == 0xFF15) ||
+		(address == 0xFF1F) ||
+		(address >= 0xFF27 && address <= 0xFF2F) ||
+		(address >= 0xFF4C && address < IORegistersEnd);
+}
+
+byte MMU::OnDIVWrite(void* context, ushort address, byte value)
+{
+	// Writing any value to DIV resets it
+	return 0x00;
+}
+
+byte MMU::OnIFRead(void* context, ushort address, byte value)
+{
+	// Only the lower 5 bits of IF exist. The upper 3 always read as 1
+	return value | 0xE0;
+}
+
+byte MMU::OnUnmappedWrite(void* context, ushort address, byte value)
+{
+	return 0xFF;
+}
+
+byte MMU::OnDMAWrite(void* context, ushort address, byte value)
+{
+	MMU* mmu = static_cast<MMU*>(context);
+	mmu->StartOAMDMA(value);
+
+	return value;
+}
+
+byte MMU::OnHDMAAddressWrite(void* context, ushort address, byte value)
+{
+	MMU* mmu = static_cast<MMU*>(context);
+	switch (address)
+	{
+	case IO::HDMA1:
+		SetHighByte(&mmu->m_state->hdmaSource, value);
+		break;
+	case IO::HDMA2:
+		SetLowByte(&mmu->m_state->hdmaSource, value & 0xF0);
+		break;
+	case IO::HDMA3:
+		SetHighByte(&mmu->m_state->hdmaDestination, value & 0x1F);
+		break;
+	case IO::HDMA4:
+		SetLowByte(&mmu->m_state->hdmaDestination, value & 0xF0);
+		break;
+	}
+
+	// The address registers are write only
+	return 0xFF;
+}
+
+byte MMU::OnHDMA5Write(void* context, ushort address, byte value)
+{
+	MMU* mmu = static_cast<MMU*>(context);
+	return mmu->StartHDMA(value);
+}
+
+void MMU::OnOAMDMAEnd(void* context, ulong lateCycles)
+{
+	MMU* mmu = static_cast<MMU*>(context);
+	mmu->m_state->isBusLocked = false;
+	mmu->UpdatePageTables();
+}
+
+void MMU::OnHDMABlock(void* context, ulong lateCycles)
+{
+	MMU* mmu = static_cast<MMU*>(context);
+	State* state = mmu->m_state;
+	if (!state->isGeneralDMAActive && !state->isHBlankDMAActive)
+	{
+		return;
+	}
+
+	// A general purpose DMA that runs late has transferred every block that was due by now
+	ulong blocks = state->isGeneralDMAActive ? 1 + lateCycles / HDMABlockCycles : 1;
+	for (; blocks > 0 && state->hdmaBlocksLeft > 0; blocks--)
+	{
+		mmu->CopyHDMABlock();
+		state->hdmaBlocksLeft--;
+	}
+
+	if (state->hdmaBlocksLeft == 0)
+	{
+		state->isGeneralDMAActive = false;
+		state->isHBlankDMAActive = false;
+		mmu->SetIORegister(IO::HDMA5, 0xFF);
+		return;
+	}
+
+	mmu->SetIORegister(IO::HDMA5, state->hdmaBlocksLeft - 1);
+
+	// A general purpose DMA goes on with the next block right away. An HBlank DMA waits for the next HBlank
+	if (state->isGeneralDMAActive)
+	{
+		mmu->m_scheduler->Schedule(SchedulerEvent::HDMABlock, HDMABlockCycles - lateCycles % HDMABlockCycles);
+	}
+}
+
+byte MMU::OnVBKWrite(void* context, ushort address, byte value)
+{
+	MMU* mmu = static_cast<MMU*>(context);
+	mmu->SelectVRAMBank(value & 0x01);
+
+	// Only bit 0 exists
+	return value | 0xFE;
+}
+
+byte MMU::OnSVBKWrite(void* context, ushort address, byte value)
+{
+	MMU* mmu = static_cast<MMU*>(context);
+
+	// Bank 0 can't be mapped to 0xD000-0xDFFF. Selecting it selects bank 1
+	byte bank = value & 0x07;
+	mmu->SelectWRAMBank(bank == 0 ? 1 : bank);
+
+	// Only bits 0-2 exist
+	return value | 0xF8;
+}
@@ -2,17 +2,247 @@
 
 #include "PCH.h"
 
+class Scheduler;
+class StateArena;
+
+/**
+* Hook that is called when the CPU reads an IO register.
+* Receives the value that is currently stored in the register and returns the value the CPU sees.
+*/
+typedef byte(*IOReadHook)(void* context, ushort address, byte value);
+
+/**
+* Hook that is called when the CPU writes an IO register.
+* Receives the value written by the CPU and returns the value that gets stored in the register.
+*/
+typedef byte(*IOWriteHook)(void* context, ushort address, byte value);
+
+/**
+* Hook that is called after a byte of VRAM (0x8000-0x9FFF) or OAM (0xFE00-0xFE9F) changed, by a CPU write or a DMA.
+* bank is the VRAM bank that was written, 0 for OAM.
+*/
+typedef void(*VideoMemoryWriteHook)(void* context, ushort address, byte bank, byte value);
+
 class MMU
 {
+public:
+	static const ushort IORegistersStart;
+	static const ushort IORegistersEnd;
+	static const ushort IORegisterCount = 0x80;
+	static const int PageCount = 0x100;
+	static const ushort PageSize = 0x100;
+
+	static const ushort VRAMStart;
+	static const ushort VRAMBankSize = 0x2000;
+	static const int VRAMBankCount = 2;
+	static const int TilesPerBank = 384; // The tile data at 0x8000-0x97FF
+	static const int TileSize = 16;
+	static const ushort ExternalRAMStart;
+	static const ushort WRAMStart;
+	static const ushort WRAMBankSize = 0x1000;
+	static const int WRAMBankCount = 8;
+	static const ushort EchoRAMStart;
+	static const ushort EchoRAMEnd;
+	static const ushort OAMStart;
+	static const ushort OAMSize;
+	static const ushort HRAMStart;
+
+	static const ulong OAMDMACycles;
+	static const ulong HDMABlockCycles;
+	static const ushort HDMABlockSize;
+
+	/**
+	* All the memory of the machine in one contiguous block, inside the state arena.
+	* Every region starts on a cache line, and the banked regions keep all of their banks next to each other.
+	*/
+	struct Memory
+	{
+		byte rom[0x8000]; // 0x0000-0x7FFF
+		byte vram[VRAMBankCount][VRAMBankSize]; // 0x8000-0x9FFF
+		byte externalRAM[0x2000]; // 0xA000-0xBFFF
+		byte wram[WRAMBankCount][WRAMBankSize]; // 0xC000-0xCFFF is always bank 0, 0xD000-0xDFFF is bank 1-7
+		byte oam[PageSize]; // 0xFE00-0xFEFF, OAM and the unusable region
+		byte high[PageSize]; // 0xFF00-0xFFFF, IO registers, HRAM and IE
+	};
+
+	/** The banking and DMA state. Lives in the state arena */
+	struct State
+	{
+		byte vramBank;
+		byte wramBank; // The bank mapped to 0xD000-0xDFFF
+		bool isBusLocked; // The OAM DMA is running in accuracy mode
+
+		// CGB general purpose and HBlank DMA
+		ushort hdmaSource;
+		ushort hdmaDestination;
+		byte hdmaBlocksLeft;
+		bool isGeneralDMAActive;
+		bool isHBlankDMAActive;
+		ulong dmaStallCycles; // Cycles the CPU is halted because of the DMA and has not yet been charged for
+	};
+
 private:
-	byte m_memory[0xFFFF + 1];
+	// A registered IO register. Null hooks mean plain storage
+	struct IORegisterHooks
+	{
+		IOReadHook read;
+		void* readContext;
+		IOWriteHook write;
+		void* writeContext;
+	};
+
+	struct IORegisterTable
+	{
+		IORegisterHooks registers[IORegisterCount];
+	};
+
+private:
+	Memory* m_memory;
+	State* m_state;
+
+	bool m_isCGB;
+
+	// Every 256 byte page of the address space is mapped to its backing memory.
+	// The CPU reads and writes through m_readPages and m_writePages. A null page goes through the slow path,
+	// which is always the case for the 0xFF page (IO, HRAM and IE), and for all pages while the bus is locked by the OAM DMA.
+	// The echo RAM pages (0xE000-0xFDFF) point at the WRAM pages, so mirroring costs nothing.
+	// The ROM pages are only mapped for reads. Their writes go through the slow path, where a MBC would take them.
+	// The 0xFE page is only mapped for reads. Its writes go through the slow path, which drops the writes
+	// to the unusable region (0xFEA0-0xFEFF), so that part of the page always reads the same constant value.
+	// Switching a VRAM or WRAM bank only repoints the pages of the bank.
+	byte* m_mappedReadPages[PageCount];
+	byte* m_mappedWritePages[PageCount];
+	byte* m_readPages[PageCount];
+	byte* m_writePages[PageCount];
+
+	Scheduler* m_scheduler;
+
+	bool m_isAccuracyMode; // Model the bus lock during OAM DMA
+
+	IORegisterTable m_ioRegisters; // Per instance copy of the shared template
+
+	VideoMemoryWriteHook m_videoMemoryWriteHook;
+	void* m_videoMemoryWriteContext;
+
+	// One bit per tile of both VRAM banks, set when the tile data changes.
+	// VRAM is only mapped for reads, so all the VRAM writes go through the slow path and mark the tiles.
+	// It's a cache of the memory and not part of the state. Loading a state marks every tile
+	uint m_dirtyTiles[VRAMBankCount * TilesPerBank / 32];
+
+	// Set when OAM changes, by the CPU or the OAM DMA. The sprite buckets clear it when they are rebuilt
+	bool m_isOAMDirty;
+
+	// Profiling counters
+	ulong m_ioReadCounts[IORegisterCount];
+	ulong m_ioWriteCounts[IORegisterCount];
 
 public:
-	MMU();
+	MMU(Scheduler* scheduler, StateArena* arena, bool isCGB);
 
 	byte ReadByte(ushort address);
 	void WriteByte(ushort address, byte value);
-	
+
 	ushort ReadUShort(ushort address);
 	void WriteUShort(ushort address, ushort value);
+
+	/** Register a hook that is called when the CPU reads the IO register at address (0xFF00-0xFF7F) */
+	void RegisterIOReadHook(ushort address, IOReadHook hook, void* context);
+
+	/** Register a hook that is called when the CPU writes the IO register at address (0xFF00-0xFF7F) */
+	void RegisterIOWriteHook(ushort address, IOWriteHook hook, void* context);
+
+	/** Set the hook that observes the VRAM and OAM writes. Null removes it */
+	void SetVideoMemoryWriteHook(VideoMemoryWriteHook hook, void* context);
+
+	/** Read an IO register without calling its hook. Used by the subsystems that own the register */
+	byte GetIORegister(ushort address) const;
+
+	/** Write an IO register without calling its hook. Used by the subsystems that own the register */
+	void SetIORegister(ushort address, byte value);
+
+	/** Set an interrupt flag in IF */
+	void RequestInterrupt(byte interrupt);
+
+	/** How many times the CPU has read the IO register at address */
+	ulong GetIOReadCount(ushort address) const;
+
+	/** How many times the CPU has written the IO register at address */
+	ulong GetIOWriteCount(ushort address) const;
+
+	void ResetIOCounters();
+
+	/** In accuracy mode the CPU can only access HRAM and the IO registers while the OAM DMA is running */
+	void SetAccuracyMode(bool isAccuracyMode);
+
+	bool IsCGB() const;
+
+	/** Called by the PPU when it enters HBlank. Starts the next block of an active HBlank DMA */
+	void OnHBlank();
+
+	/** Returns the cycles the CPU was halted by DMA transfers since the last call */
+	ulong TakeDMAStallCycles();
+
+	/** Direct access to the memory of the machine, for the subsystems that render it */
+	Memory* GetMemory();
+
+	/** The dirty bitmap of the VRAM tiles. Bank 1 tiles come after the bank 0 tiles. The tile cache clears the bits */
+	uint* GetDirtyTiles();
+
+	/** The flag that is set when OAM changes. The sprite buckets clear it */
+	bool* GetOAMDirtyFlag();
+
+	/** Rebuild the page tables after the state was loaded from a snapshot */
+	void OnStateLoaded();
+
+private:
+	byte ReadByteSlow(ushort address);
+	void WriteByteSlow(ushort address, byte value);
+
+	byte ReadIORegister(ushort address);
+	void WriteIORegister(ushort address, byte value);
+
+	/** Map every page to its backing memory */
+	void MapMemoryPages();
+
+	/** Map the pages of a region to the backing memory. The echo of the region is mapped too */
+	void MapPages(ushort address, ushort size, byte* read, byte* write);
+
+	/** Rebuild the CPU view of the pages */
+	void UpdatePageTables();
+
+	void SelectVRAMBank(byte bank);
+
+	/** Pass a changed VRAM or OAM block to the video memory write hook */
+	void NotifyVideoMemoryWrite(ushort address, byte bank, const byte* data, ushort size);
+
+	/** Mark the tile at offset in the VRAM bank, if the offset is in the tile data */
+	void MarkTileDirty(byte bank, ushort offset);
+	void MarkAllTilesDirty();
+	void SelectWRAMBank(byte bank);
+
+	void StartOAMDMA(byte sourcePage);
+	byte StartHDMA(byte value);
+
+	/** Copy one 16 byte block from the HDMA source to VRAM and advance the addresses */
+	void CopyHDMABlock();
+
+	/** The hooks that every MMU starts with. Built once per hardware model and shared by all instances */
+	static const IORegisterTable& GetIORegisterTemplate(bool isCGB);
+	static IORegisterTable BuildIORegisterTemplate(bool isCGB);
+
+	static bool IsUnmappedIORegister(ushort address);
+
+	// Template hooks. The context is the MMU itself
+	static byte OnDIVWrite(void* context, ushort address, byte value);
+	static byte OnIFRead(void* context, ushort address, byte value);
+	static byte OnUnmappedWrite(void* context, ushort address, byte value);
+
+	static byte OnDMAWrite(void* context, ushort address, byte value);
+	static byte OnHDMAAddressWrite(void* context, ushort address, byte value);
+	static byte OnHDMA5Write(void* context, ushort address, byte value);
+	static void OnOAMDMAEnd(void* context, ulong lateCycles);
+	static void OnHDMABlock(void* context, ulong lateCycles);
+
+	static byte OnVBKWrite(void* context, ushort address, byte value);
+	static byte OnSVBKWrite(void* context, ushort address, byte value);
 };
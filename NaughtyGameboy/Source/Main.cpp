@@ -1,44 +1,522 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <thread>
+#ifndef HEADLESS_BUILD
 #include <SDL.h>
+#endif
 #include "PCH.h"
-#include "CPU.h"
+#include "Benchmark.h"
+#include "EmulationThread.h"
+#include "FrameDumpSink.h"
+#include "FrameHashLog.h"
+#include "FrameSkipper.h"
+#include "Gameboy.h"
+#include "HeadlessVideoSink.h"
+#ifndef HEADLESS_BUILD
 #include "LCD.h"
+#endif
 #include "Logger.h"
+#include "ObservationStack.h"
+#include "Scalers.h"
+#include "ThumbnailGrid.h"
+#include "TripleBuffer.h"
 
-const ulong CyclesPerFrame = 70224;
-const int ScreenWidth = 160 * 2;
-const int ScreenHeight = 144 * 2;
+const int DefaultScale = 2;
+const double DefaultGridRate = 30.0;
 
-int main(int argc, char* argv[])
+class LCD;
+
+/**
+* Run instanceCount machines on as many threads as the host has cores to spare, and show them all in one window as a grid
+* of thumbnails. The grid is refreshed refreshRate times a second, whatever the speed of the emulation.
+* Without a window the grid is still composed, to measure what it costs
+*/
+static void RunGrid(int instanceCount, int shrinkShift, double refreshRate, ulong frameLimit, PPUBackend ppuBackend, LCD* lcd)
 {
-	LCD lcd = LCD();
-	lcd.Init();
-	lcd.CreateWindow(ScreenWidth, ScreenHeight);
+	std::vector<std::unique_ptr<Gameboy>> instances;
+	std::vector<std::unique_ptr<TripleBuffer>> buffers;
+	for (int i = 0; i < instanceCount; i++)
+	{
+		instances.push_back(std::make_unique<Gameboy>(false, ppuBackend));
+		buffers.push_back(std::make_unique<TripleBuffer>());
+	}
 
-	CPU cpu = CPU();
+	// The instances are dealt to the threads in turn. One core is left to the grid
+	int threadCount = std::min(instanceCount, std::max((int)std::thread::hardware_concurrency() - 1, 1));
+	std::vector<std::unique_ptr<EmulationThread>> threads;
+	std::vector<TripleBuffer*> sources;
+	for (int thread = 0; thread < threadCount; thread++)
+	{
+		std::vector<Gameboy*> threadInstances;
+		std::vector<TripleBuffer*> threadBuffers;
+		for (int i = thread; i < instanceCount; i += threadCount)
+		{
+			threadInstances.push_back(instances[i].get());
+			threadBuffers.push_back(buffers[i].get());
+		}
+
+		threads.push_back(std::make_unique<EmulationThread>(threadInstances, threadBuffers, frameLimit));
+	}
 
-	ulong cycles = 0;
+	for (const std::unique_ptr<TripleBuffer>& buffer : buffers)
+	{
+		sources.push_back(buffer.get());
+	}
+
+	ThumbnailGrid grid(sources, (int)std::ceil(std::sqrt((double)instanceCount)), shrinkShift);
+
+	const std::chrono::duration<double> refreshInterval(1.0 / refreshRate);
+	std::chrono::steady_clock::time_point nextRefresh = std::chrono::steady_clock::now();
+	double composeMilliseconds = 0.0;
+	ulonglong refreshCount = 0;
 
-	SDL_Event sdlEvent;
 	bool isRunning = true;
 	while (isRunning)
 	{
-		SDL_WaitEvent(&sdlEvent);
-		if (sdlEvent.type == SDL_QUIT)
+#ifndef HEADLESS_BUILD
+		if (lcd != nullptr)
+		{
+			SDL_Event sdlEvent;
+			while (SDL_PollEvent(&sdlEvent))
+			{
+				if (sdlEvent.type == SDL_QUIT)
+				{
+					isRunning = false;
+				}
+			}
+		}
+#endif
+
+		std::chrono::steady_clock::time_point composeStart = std::chrono::steady_clock::now();
+		bool isChanged = grid.Update();
+
+		std::chrono::duration<double, std::milli> composeTime = std::chrono::steady_clock::now() - composeStart;
+		composeMilliseconds += composeTime.count();
+		refreshCount++;
+
+#ifndef HEADLESS_BUILD
+		if (lcd != nullptr && isChanged)
+		{
+			lcd->PresentPicture(grid.GetCanvas(), grid.GetWidth(), grid.GetHeight());
+		}
+#else
+		(void)isChanged;
+		(void)lcd;
+#endif
+
+		bool isDone = std::all_of(threads.begin(), threads.end(), [](const std::unique_ptr<EmulationThread>& thread) { return thread->IsDone(); });
+		if (isDone)
 		{
 			isRunning = false;
 		}
 
-		while (cycles < CyclesPerFrame)
+		nextRefresh += std::chrono::duration_cast<std::chrono::steady_clock::duration>(refreshInterval);
+		std::this_thread::sleep_until(nextRefresh);
+	}
+
+	ulonglong frameCount = 0;
+	for (std::unique_ptr<EmulationThread>& thread : threads)
+	{
+		thread->Stop();
+		frameCount += thread->GetFrameCount();
+	}
+
+	Logger::Log("Grid: %d instances on %d threads, %llu frames emulated", instanceCount, threadCount, frameCount);
+	Logger::Log("Grid: %llu refreshes, %llu tiles drawn, %.3f ms per refresh", refreshCount, grid.GetUpdatedTileCount(),
+		(refreshCount > 0) ? composeMilliseconds / refreshCount : 0.0);
+}
+
+int main(int argc, char* argv[])
+{
+	PPUBackend ppuBackend = PPUBackend::Scanline;
+#ifndef HEADLESS_BUILD
+	// The window options. A headless build has no window
+	int scale = DefaultScale;
+	bool isSoftwareRenderer = false;
+	bool isHeadless = false;
+	ScaleFilter scaleFilter = ScaleFilter::None;
+#endif
+	bool isSingleThreaded = false; // Emulate and present on the same thread, like before the triple buffer
+	ulong frameLimit = 0; // 0 runs until the window is closed
+	int frameSkip = 0;
+	bool isAutoFrameSkip = false;
+	const char* dumpPath = nullptr;
+	FrameDumpFormat dumpFormat = FrameDumpFormat::Y4M;
+	FrameDumpPolicy dumpPolicy = FrameDumpPolicy::Block;
+	const char* hashLogPath = nullptr;
+	bool isHashLogBinary = false;
+	int gridInstanceCount = 0; // 0 runs a single instance
+	int gridShrinkShift = 1;
+	double gridRate = DefaultGridRate;
+	int observationWidth = 0; // 0 doesn't build observations
+	int observationHeight = 0;
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::strcmp(argv[i], "--bench-kernels") == 0)
+		{
+			Benchmark::RunPixelKernels();
+			return 0;
+		}
+
+		if (std::strcmp(argv[i], "--bench-scalers") == 0)
+		{
+			Benchmark::RunScalers();
+			return 0;
+		}
+
+		if (std::strcmp(argv[i], "--bench-hash") == 0)
+		{
+			Benchmark::RunFrameHash();
+			return 0;
+		}
+
+		if (std::strcmp(argv[i], "--ppu-fifo") == 0)
+		{
+			ppuBackend = PPUBackend::PixelFIFO;
+		}
+
+		if (std::strcmp(argv[i], "--ppu-threaded") == 0)
+		{
+			ppuBackend = PPUBackend::ThreadedScanline;
+		}
+
+#ifndef HEADLESS_BUILD
+		if (std::strcmp(argv[i], "--scale") == 0 && i + 1 < argc)
+		{
+			scale = std::atoi(argv[++i]);
+			scale = (scale > 0) ? scale : DefaultScale;
+		}
+
+		if (std::strcmp(argv[i], "--software-renderer") == 0)
+		{
+			isSoftwareRenderer = true;
+		}
+
+		if (std::strcmp(argv[i], "--headless") == 0)
+		{
+			isHeadless = true;
+		}
+
+		// --filter nearest2x|nearest3x|nearest4x|scale2x|smooth2x scales the picture on the CPU before it's uploaded
+		if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+		{
+			scaleFilter = Scalers::FromName(argv[++i]);
+		}
+#endif
+
+		if (std::strcmp(argv[i], "--single-thread") == 0)
+		{
+			isSingleThreaded = true;
+		}
+
+		if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+		{
+			frameLimit = std::strtoul(argv[++i], nullptr, 10);
+		}
+
+		// --frameskip N draws one frame out of every N + 1, --frameskip auto skips frames when the host falls behind
+		if (std::strcmp(argv[i], "--frameskip") == 0 && i + 1 < argc)
+		{
+			i++;
+			isAutoFrameSkip = (std::strcmp(argv[i], "auto") == 0);
+			frameSkip = isAutoFrameSkip ? 0 : std::atoi(argv[i]);
+		}
+
+		// --dump <file> or --dump "|<command>" records the drawn frames. --dump-format y4m|raw, --dump-drop drops frames instead of waiting for the disk
+		if (std::strcmp(argv[i], "--dump") == 0 && i + 1 < argc)
 		{
-			cycles += cpu.Step();
+			dumpPath = argv[++i];
 		}
 
-		cycles -= CyclesPerFrame;
+		if (std::strcmp(argv[i], "--dump-format") == 0 && i + 1 < argc)
+		{
+			FrameDumpFormat format = FrameDumpSink::GetFormat(argv[++i]);
+			dumpFormat = (format != FrameDumpFormat::Count) ? format : dumpFormat;
+		}
+
+		if (std::strcmp(argv[i], "--dump-drop") == 0)
+		{
+			dumpPolicy = FrameDumpPolicy::Drop;
+		}
+
+		// --hash-log <file> writes the hash of every drawn frame as text, --hash-log-binary <file> in the compact binary format
+		if ((std::strcmp(argv[i], "--hash-log") == 0 || std::strcmp(argv[i], "--hash-log-binary") == 0) && i + 1 < argc)
+		{
+			isHashLogBinary = (std::strcmp(argv[i], "--hash-log-binary") == 0);
+			hashLogPath = argv[++i];
+		}
+
+		// --grid N runs N instances and shows them as thumbnails, halved --grid-shrink 0-2 times, refreshed --grid-rate times a second
+		if (std::strcmp(argv[i], "--grid") == 0 && i + 1 < argc)
+		{
+			gridInstanceCount = std::max(std::atoi(argv[++i]), 0);
+		}
+
+		if (std::strcmp(argv[i], "--grid-shrink") == 0 && i + 1 < argc)
+		{
+			gridShrinkShift = std::atoi(argv[++i]);
+		}
+
+		if (std::strcmp(argv[i], "--grid-rate") == 0 && i + 1 < argc)
+		{
+			gridRate = std::atof(argv[++i]);
+			gridRate = (gridRate > 0.0) ? gridRate : DefaultGridRate;
+		}
+
+		// --observation WxH builds the max pooled 4 frame observations an agent would get, to measure what they cost
+		if (std::strcmp(argv[i], "--observation") == 0 && i + 1 < argc)
+		{
+			i++;
+			if (std::sscanf(argv[i], "%dx%d", &observationWidth, &observationHeight) != 2)
+			{
+				observationWidth = 0;
+			}
+		}
+	}
+
+	// The headless sink doesn't touch SDL at all, so it starts instantly and works without a display
+	std::unique_ptr<VideoSink> videoSink;
+	LCD* lcd = nullptr;
+#ifndef HEADLESS_BUILD
+	if (!isHeadless)
+	{
+		std::unique_ptr<LCD> window = std::make_unique<LCD>();
+		window->Init();
+		window->CreateWindow(LCDWidth * scale, LCDHeight * scale, isSoftwareRenderer);
+		window->SetScaleFilter(scaleFilter);
+
+		lcd = window.get();
+		videoSink = std::move(window);
+	}
+#endif
+
+	if (videoSink == nullptr)
+	{
+		videoSink = std::make_unique<HeadlessVideoSink>(false);
+	}
+
+	if (gridInstanceCount > 0)
+	{
+		RunGrid(gridInstanceCount, gridShrinkShift, gridRate, frameLimit, ppuBackend, lcd);
+
+#ifndef HEADLESS_BUILD
+		if (lcd != nullptr)
+		{
+			lcd->DestroyWindow();
+			lcd->Deinit();
+		}
+#endif
+
+		return 0;
+	}
+
+	Gameboy gameboy(false, ppuBackend);
+	FrameSkipper frameSkipper(frameSkip, isAutoFrameSkip);
+
+	std::unique_ptr<FrameHashLog> hashLog;
+	if (hashLogPath != nullptr)
+	{
+		hashLog = std::make_unique<FrameHashLog>(hashLogPath, isHashLogBinary);
+		gameboy.GetPPU()->SetFrameHashing(true);
+
+		// Without a window, a dump or observations nothing needs the colors, so the PPU draws the shade numbers.
+		// They are a quarter of the bytes of ARGB8888 to hash, but the hashes differ from the ones of a run with a window
+		if (lcd == nullptr && dumpPath == nullptr && observationWidth == 0)
+		{
+			gameboy.GetPPU()->SetPixelFormat(PixelFormat::Index8);
+		}
+	}
+
+	std::unique_ptr<FrameDumpSink> frameDump;
+	if (dumpPath != nullptr)
+	{
+		frameDump = std::make_unique<FrameDumpSink>(dumpPath, dumpFormat, dumpPolicy);
 	}
 
-	lcd.DestroyWindow();
-	lcd.Deinit();
+	const int ObservationStackSize = 4;
+	std::unique_ptr<ObservationStack> observations;
+	std::unique_ptr<byte[]> observationBuffer;
+	double observationMilliseconds = 0.0;
+	if (observationWidth > 0)
+	{
+		observations = std::make_unique<ObservationStack>(observationWidth, observationHeight, ObservationStackSize, true);
+		observationBuffer = std::make_unique<byte[]>(observations->GetBufferSize());
+		observations->SetBuffer(observationBuffer.get());
+	}
+
+	// With a window the emulation runs on a thread of its own and hands the frames over through a triple buffer,
+	// so the presentation and the wait for the vertical sync never hold it up. The PPU draws straight into the back buffer.
+	std::unique_ptr<TripleBuffer> presentBuffer;
+	if (lcd != nullptr && !isSingleThreaded)
+	{
+		presentBuffer = std::make_unique<TripleBuffer>();
+		gameboy.GetPPU()->SetFramebuffer(presentBuffer->GetBackBuffer());
+	}
+
+	ulong frames = 0;
+	ulong renderedFrames = 0;
+	std::atomic<bool> isRunning(true);
+
+	auto pollEvents = [&]()
+	{
+#ifndef HEADLESS_BUILD
+		if (lcd != nullptr)
+		{
+			SDL_Event sdlEvent;
+			while (SDL_PollEvent(&sdlEvent))
+			{
+				if (sdlEvent.type == SDL_QUIT)
+				{
+					isRunning = false;
+				}
+			}
+		}
+#endif
+	};
+
+	auto runFrame = [&]()
+	{
+		std::chrono::steady_clock::time_point frameStart = std::chrono::steady_clock::now();
+
+		bool isRendered = frameSkipper.ShouldRender();
+		gameboy.GetPPU()->SetRenderEnabled(isRendered);
+
+		// Run up to the VBlank, so the presented picture is one whole frame
+		EmulationThread::RunFrame(&gameboy);
+
+		ulong hashedFrame;
+		ulonglong frameHash;
+		if (hashLog != nullptr && gameboy.GetPPU()->TakeFrameHash(&hashedFrame, &frameHash))
+		{
+			hashLog->Add(hashedFrame, frameHash);
+		}
+
+		// A skipped frame leaves the last picture on the screen
+		if (isRendered)
+		{
+			renderedFrames++;
+
+			if (frameDump != nullptr)
+			{
+				frameDump->Present(gameboy.GetPPU()->GetFramebuffer());
+			}
+
+			if (observations != nullptr)
+			{
+				std::chrono::steady_clock::time_point observationStart = std::chrono::steady_clock::now();
+				observations->AddFrame(gameboy.GetPPU()->GetPixels(), gameboy.GetPPU()->GetPixelFormat());
+
+				std::chrono::duration<double, std::milli> observationTime = std::chrono::steady_clock::now() - observationStart;
+				observationMilliseconds += observationTime.count();
+			}
+
+			// Publishing hands the frame over as it is. The PPU goes on in the buffer it gets back
+			if (presentBuffer != nullptr)
+			{
+				gameboy.GetPPU()->GetPixels(); // Waits for the render worker to finish the frame
+				presentBuffer->Publish();
+				gameboy.GetPPU()->SetFramebuffer(presentBuffer->GetBackBuffer());
+			}
+			else
+			{
+				videoSink->Present(gameboy.GetPPU()->GetFramebuffer());
+			}
+		}
+
+		std::chrono::duration<double, std::milli> frameTime = std::chrono::steady_clock::now() - frameStart;
+		frameSkipper.EndFrame(isRendered, frameTime.count());
+
+		frames++;
+		if (frameLimit > 0 && frames >= frameLimit)
+		{
+			isRunning = false;
+		}
+	};
+
+	if (presentBuffer != nullptr)
+	{
+		// Nothing throttles the emulation thread anymore, so it keeps the speed of the Game Boy itself.
+		// After a stall it starts over instead of running fast to catch up
+		std::thread emulation([&]()
+		{
+			const std::chrono::duration<double, std::milli> frameDuration(FrameSkipper::FrameMilliseconds);
+			std::chrono::steady_clock::time_point nextFrame = std::chrono::steady_clock::now();
+			while (isRunning)
+			{
+				runFrame();
+
+				nextFrame += std::chrono::duration_cast<std::chrono::steady_clock::duration>(frameDuration);
+				std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+				if (now > nextFrame + frameDuration)
+				{
+					nextFrame = now;
+				}
+
+				std::this_thread::sleep_until(nextFrame);
+			}
+		});
+
+		// The presenter shows the newest frame. When there is none yet it waits a little instead of spinning
+		while (isRunning)
+		{
+			pollEvents();
+
+			if (presentBuffer->TakeNewest())
+			{
+				videoSink->Present(presentBuffer->GetFrontBuffer());
+			}
+			else
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+		}
+
+		emulation.join();
+	}
+	else
+	{
+		while (isRunning)
+		{
+			pollEvents();
+			runFrame();
+		}
+	}
+
+	Logger::Log("Frames: %lu emulated, %lu drawn", frames, renderedFrames);
+
+	if (frameDump != nullptr)
+	{
+		// Waits for the writer to finish, so the counts are final
+		frameDump->Close();
+		Logger::Log("Frame dump: %llu frames, %llu written, %llu dropped%s", frameDump->GetFrameCount(),
+			frameDump->GetWrittenCount(), frameDump->GetDroppedCount(), frameDump->HasWriteFailed() ? ", write failed" : "");
+	}
+
+	if (observations != nullptr && observations->GetObservationCount() > 0)
+	{
+		Logger::Log("Observations: %llu of %dx%d, %.3f ms each", observations->GetObservationCount(),
+			observations->GetWidth(), observations->GetHeight(), observationMilliseconds / observations->GetObservationCount());
+	}
+
+	const TileCache::Stats& tileCacheStats = gameboy.GetPPU()->GetTileCacheStats();
+	Logger::Log("Tile cache: %llu hits, %llu misses, %.2f%% hit rate",
+		tileCacheStats.hits, tileCacheStats.misses, tileCacheStats.GetHitRate() * 100.0f);
+
+#ifndef HEADLESS_BUILD
+	if (lcd != nullptr)
+	{
+		Logger::Log("Present: %.3f ms per frame", lcd->GetAveragePresentTime());
+
+		lcd->DestroyWindow();
+		lcd->Deinit();
+	}
+#endif
 
 	return 0;
 }
@@ -0,0 +1,249 @@
+#include <algorithm>
+#include <cstring>
+#include "ObservationStack.h"
+#include "CPUFeatures.h"
+
+#if HAS_X86_SIMD
+#include <emmintrin.h>
+#endif
+
+ObservationStack::ObservationStack(int width, int height, int stackSize, bool isMaxPooled) :
+	m_width(std::min(std::max(width, 1), LCDWidth)),
+	m_height(std::min(std::max(height, 1), LCDHeight)),
+	m_stackSize(std::max(stackSize, 1)),
+	m_isMaxPooled(isMaxPooled),
+	m_buffer(nullptr),
+	m_newestSlot(-1),
+	m_observationCount(0),
+	m_poolIndex(0),
+	m_hasPoolPartner(false),
+	m_areaScaleRowCount(0)
+{
+	// Every output pixel averages the source pixels it covers. The areas differ by at most a line or a column
+	for (int y = 0; y < m_height; y++)
+	{
+		m_rowStarts[y] = (byte)(y * LCDHeight / m_height);
+		m_rowCounts[y] = (byte)((y + 1) * LCDHeight / m_height - m_rowStarts[y]);
+	}
+
+	for (int x = 0; x < m_width; x++)
+	{
+		m_columnStarts[x] = (byte)(x * LCDWidth / m_width);
+		m_columnCounts[x] = (byte)((x + 1) * LCDWidth / m_width - m_columnStarts[x]);
+	}
+
+	if (m_isMaxPooled)
+	{
+		m_poolFrames[0] = std::make_unique<byte[]>(m_width * m_height);
+		m_poolFrames[1] = std::make_unique<byte[]>(m_width * m_height);
+	}
+}
+
+size_t ObservationStack::GetBufferSize() const
+{
+	return (size_t)m_stackSize * m_width * m_height;
+}
+
+void ObservationStack::SetBuffer(byte* buffer)
+{
+	m_buffer = buffer;
+	Reset();
+}
+
+void ObservationStack::Reset()
+{
+	if (m_buffer != nullptr)
+	{
+		std::memset(m_buffer, 0, GetBufferSize());
+	}
+
+	m_newestSlot = -1;
+	m_observationCount = 0;
+	m_hasPoolPartner = false;
+}
+
+bool ObservationStack::AddFrame(const byte* pixels, PixelFormat format, bool isPushed /*= true*/)
+{
+	if ((format != PixelFormat::Gray8 && format != PixelFormat::ARGB8888) || (isPushed && m_buffer == nullptr))
+	{
+		return false;
+	}
+
+	const int size = m_width * m_height;
+	int slot = (m_newestSlot + 1) % m_stackSize;
+	byte* observation = m_buffer + slot * size;
+
+	if (!m_isMaxPooled)
+	{
+		// Without pooling a frame that isn't pushed is never seen, and a pushed one goes straight into the ring
+		if (isPushed)
+		{
+			Downsample(pixels, format, observation);
+		}
+	}
+	else
+	{
+		m_poolIndex ^= 1;
+		byte* frame = m_poolFrames[m_poolIndex].get();
+		Downsample(pixels, format, frame);
+
+		if (isPushed)
+		{
+			const byte* partner = m_hasPoolPartner ? m_poolFrames[m_poolIndex ^ 1].get() : frame;
+			MaxPool(frame, partner, observation, size);
+		}
+
+		m_hasPoolPartner = true;
+	}
+
+	if (isPushed)
+	{
+		m_newestSlot = slot;
+		m_observationCount++;
+	}
+
+	return true;
+}
+
+int ObservationStack::GetNewestSlot() const
+{
+	return m_newestSlot;
+}
+
+const byte* ObservationStack::GetNewestObservation() const
+{
+	if (m_newestSlot < 0)
+	{
+		return nullptr;
+	}
+
+	return m_buffer + m_newestSlot * m_width * m_height;
+}
+
+ulonglong ObservationStack::GetObservationCount() const
+{
+	return m_observationCount;
+}
+
+int ObservationStack::GetWidth() const
+{
+	return m_width;
+}
+
+int ObservationStack::GetHeight() const
+{
+	return m_height;
+}
+
+int ObservationStack::GetStackSize() const
+{
+	return m_stackSize;
+}
+
+void ObservationStack::Downsample(const byte* pixels, PixelFormat format, byte* output)
+{
+	for (int y = 0; y < m_height; y++)
+	{
+		int rowCount = m_rowCounts[y];
+		if (rowCount != m_areaScaleRowCount)
+		{
+			UpdateAreaScales(rowCount);
+		}
+
+		SumLines(pixels, format, m_rowStarts[y], rowCount);
+
+		byte* row = output + y * m_width;
+		for (int x = 0; x < m_width; x++)
+		{
+			const ushort* sums = m_columnSums + m_columnStarts[x];
+			uint sum = 0;
+			for (int i = 0; i < m_columnCounts[x]; i++)
+			{
+				sum += sums[i];
+			}
+
+			// The scale is rounded down, so the rounded average can't go over 255
+			row[x] = (byte)((sum * m_areaScales[x] + 0x80000000) >> 32);
+		}
+	}
+}
+
+void ObservationStack::UpdateAreaScales(int rowCount)
+{
+	for (int x = 0; x < m_width; x++)
+	{
+		m_areaScales[x] = 0x100000000ULL / (rowCount * m_columnCounts[x]);
+	}
+
+	m_areaScaleRowCount = rowCount;
+}
+
+void ObservationStack::SumLines(const byte* pixels, PixelFormat format, int startY, int count)
+{
+	std::memset(m_columnSums, 0, sizeof(m_columnSums));
+
+	for (int y = startY; y < startY + count; y++)
+	{
+		const byte* line = GetGrayLine(pixels, format, y);
+		int x = 0;
+
+#if HAS_X86_SIMD
+		if (CPUFeatures::Get().hasSSE2)
+		{
+			// 16 pixels at a time, widened to 16 bits. A column of 144 white pixels still fits
+			__m128i zero = _mm_setzero_si128();
+			for (; x + 16 <= LCDWidth; x += 16)
+			{
+				__m128i gray = _mm_loadu_si128(reinterpret_cast<const __m128i*>(line + x));
+				__m128i* sums = reinterpret_cast<__m128i*>(m_columnSums + x);
+				_mm_storeu_si128(sums, _mm_add_epi16(_mm_loadu_si128(sums), _mm_unpacklo_epi8(gray, zero)));
+				_mm_storeu_si128(sums + 1, _mm_add_epi16(_mm_loadu_si128(sums + 1), _mm_unpackhi_epi8(gray, zero)));
+			}
+		}
+#endif
+
+		for (; x < LCDWidth; x++)
+		{
+			m_columnSums[x] += line[x];
+		}
+	}
+}
+
+const byte* ObservationStack::GetGrayLine(const byte* pixels, PixelFormat format, int y)
+{
+	if (format == PixelFormat::Gray8)
+	{
+		return pixels + y * LCDWidth;
+	}
+
+	// The same luma as the Gray8 shades, so both formats give the same observations
+	const uint* line = reinterpret_cast<const uint*>(pixels) + y * LCDWidth;
+	for (int x = 0; x < LCDWidth; x++)
+	{
+		m_grayLine[x] = PixelFormats::GetLuma(line[x]);
+	}
+
+	return m_grayLine;
+}
+
+void ObservationStack::MaxPool(const byte* a, const byte* b, byte* output, int size)
+{
+	int i = 0;
+
+#if HAS_X86_SIMD
+	if (CPUFeatures::Get().hasSSE2)
+	{
+		for (; i + 16 <= size; i += 16)
+		{
+			__m128i pixelsA = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+			__m128i pixelsB = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), _mm_max_epu8(pixelsA, pixelsB));
+		}
+	}
+#endif
+
+	for (; i < size; i++)
+	{
+		output[i] = std::max(a[i], b[i]);
+	}
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "PCH.h"
+#include "PixelFormat.h"
+#include "PPURegisters.h"
+
+/**
+* Turns the frames of the PPU into observations for reinforcement learning agents: grayscale pictures downsampled to
+* width x height, optionally max pooled with the frame before, written into a ring buffer of the last stackSize
+* observations that the caller owns. Everything is allocated up front, a step allocates nothing.
+* Gray8 frames are read in place, which makes it the format to render in. ARGB8888 frames are converted a line at a time.
+*/
+class ObservationStack
+{
+private:
+	int m_width;
+	int m_height;
+	int m_stackSize;
+	bool m_isMaxPooled;
+
+	byte* m_buffer; // Owned by the caller. m_stackSize observations of m_width * m_height bytes
+	int m_newestSlot; // -1 until the first observation
+	ulonglong m_observationCount;
+
+	// The source lines and columns that every output row and column averages
+	byte m_rowStarts[LCDHeight];
+	byte m_rowCounts[LCDHeight];
+	byte m_columnStarts[LCDWidth];
+	byte m_columnCounts[LCDWidth];
+
+	// The downsampled frames that are pooled. The newest one alternates between the two
+	std::unique_ptr<byte[]> m_poolFrames[2];
+	int m_poolIndex;
+	bool m_hasPoolPartner;
+
+	// Scratch for a downsampled row: the column sums of the source lines, and a source line converted to gray
+	ushort m_columnSums[LCDWidth];
+	byte m_grayLine[LCDWidth];
+
+	// 2^32 / area for the areas of the output columns. The areas only change with the number of source lines of the row
+	ulonglong m_areaScales[LCDWidth];
+	int m_areaScaleRowCount;
+
+public:
+	/** width and height are at most LCDWidth and LCDHeight */
+	ObservationStack(int width, int height, int stackSize, bool isMaxPooled);
+
+	ObservationStack(const ObservationStack&) = delete;
+	ObservationStack& operator=(const ObservationStack&) = delete;
+
+	/** The bytes the ring buffer needs, stackSize * width * height */
+	size_t GetBufferSize() const;
+
+	/** Write the observations into buffer from now on, which must be GetBufferSize() bytes. Resets the stack */
+	void SetBuffer(byte* buffer);
+
+	/** Clear the ring buffer and forget the pooled frame, at the start of an episode */
+	void Reset();
+
+	/**
+	* Downsample a LCDWidth x LCDHeight frame, in Gray8 or ARGB8888. Returns false for the other formats.
+	* A pushed frame becomes the newest observation. When max pooling, every frame also becomes the partner of the next one,
+	* so the frames that are skipped between the observations can still be pooled by adding them with isPushed false.
+	*/
+	bool AddFrame(const byte* pixels, PixelFormat format, bool isPushed = true);
+
+	/** The slot of the newest observation in the ring buffer. The older ones are in the slots before it. -1 if there is none yet */
+	int GetNewestSlot() const;
+
+	/** The newest observation, width * height bytes. Null if there is none yet */
+	const byte* GetNewestObservation() const;
+
+	ulonglong GetObservationCount() const;
+
+	int GetWidth() const;
+	int GetHeight() const;
+	int GetStackSize() const;
+
+private:
+	void Downsample(const byte* pixels, PixelFormat format, byte* output);
+
+	/** Compute m_areaScales for the output rows that average rowCount source lines */
+	void UpdateAreaScales(int rowCount);
+
+	/** Sum count source lines into m_columnSums */
+	void SumLines(const byte* pixels, PixelFormat format, int startY, int count);
+
+	/** The gray pixels of a source line. Gray8 lines are returned in place */
+	const byte* GetGrayLine(const byte* pixels, PixelFormat format, int y);
+
+	static void MaxPool(const byte* a, const byte* b, byte* output, int size);
+};
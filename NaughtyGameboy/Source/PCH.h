@@ -7,4 +7,6 @@
 typedef unsigned char byte;
 typedef signed char sbyte;
 typedef unsigned short ushort;
+typedef unsigned int uint;
 typedef unsigned long ulong;
+typedef unsigned long long ulonglong;
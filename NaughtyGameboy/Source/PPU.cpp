@@ -0,0 +1,790 @@
+#include <cstring>
+#include "PPU.h"
+#include "BitUtil.h"
+#include "CGBColors.h"
+#include "FrameHash.h"
+#include "IORegisters.h"
+#include "MMU.h"
+#include "Scheduler.h"
+#include "StateArena.h"
+
+const ulong PPU::OAMScanCycles = 80;
+const ulong PPU::TransferCycles = 172;
+const ulong PPU::HBlankCycles = 204;
+const ulong PPU::LineCycles = 456;
+const int PPU::LineCount = 154;
+
+PPU::PPU(MMU* mmu, Scheduler* scheduler, StateArena* arena, PPUBackend backend) :
+	m_state(arena->Allocate<State>()),
+	m_MMU(mmu),
+	m_scheduler(scheduler),
+	m_tileCache(mmu->GetMemory()->vram[0], mmu->GetDirtyTiles(), mmu->IsCGB() ? MMU::VRAMBankCount : 1, true),
+	m_spriteBuckets(mmu->GetMemory()->oam, mmu->GetOAMDirtyFlag()),
+	m_backend(backend),
+	m_renderer(mmu->GetMemory()->vram[0], mmu->GetMemory()->oam, &m_tileCache, &m_spriteBuckets),
+	m_fifoRenderer(mmu->GetMemory()->vram[0], mmu->GetMemory()->oam, mmu->GetMemory()->high, &m_tileCache, &m_spriteBuckets, arena),
+	m_framebuffer(m_ownFramebuffer),
+	m_pixelFormat(PixelFormat::ARGB8888),
+	m_isRenderRequested(true),
+	m_isRenderingFrame(true),
+	m_isFrameHashing(false),
+	m_hasNewFrameHash(false),
+	m_hashedFrame(0),
+	m_frameHash(0),
+	m_isBlankTransfer(false),
+	m_savedShades(),
+	m_nextSavedShades(0),
+	m_cgbColorTable(CGBColors::GetTable(true))
+{
+	std::memset(m_blankLineShades, NotBlankLine, sizeof(m_blankLineShades));
+	ClearFramebuffer();
+
+	// The LCD starts off. Bit 7 of STAT is always set
+	m_MMU->SetIORegister(IO::STAT, 0x80);
+
+	m_scheduler->Register(SchedulerEvent::PPUModeEnd, &PPU::OnModeEnd, this);
+
+	m_MMU->RegisterIOWriteHook(IO::LCDC, &PPU::OnLCDCWrite, this);
+	m_MMU->RegisterIOWriteHook(IO::STAT, &PPU::OnSTATWrite, this);
+	m_MMU->RegisterIOWriteHook(IO::LY, &PPU::OnLYWrite, this);
+	m_MMU->RegisterIOWriteHook(IO::LYC, &PPU::OnLYCWrite, this);
+
+	UpdateCGBColors();
+	if (m_MMU->IsCGB())
+	{
+		m_MMU->RegisterIOWriteHook(IO::BCPS, &PPU::OnPaletteIndexWrite, this);
+		m_MMU->RegisterIOWriteHook(IO::OCPS, &PPU::OnPaletteIndexWrite, this);
+		m_MMU->RegisterIOReadHook(IO::BCPD, &PPU::OnPaletteDataRead, this);
+		m_MMU->RegisterIOReadHook(IO::OCPD, &PPU::OnPaletteDataRead, this);
+		m_MMU->RegisterIOWriteHook(IO::BCPD, &PPU::OnPaletteDataWrite, this);
+		m_MMU->RegisterIOWriteHook(IO::OCPD, &PPU::OnPaletteDataWrite, this);
+	}
+
+	if (m_backend == PPUBackend::ThreadedScanline)
+	{
+		m_worker = std::make_unique<RenderWorker>(reinterpret_cast<byte*>(m_framebuffer), mmu->IsCGB() ? MMU::VRAMBankCount : 1);
+		m_worker->Reset(*mmu->GetMemory());
+		m_MMU->SetVideoMemoryWriteHook(&PPU::OnVideoMemoryWrite, this);
+	}
+
+	const ushort renderRegisters[] = { IO::SCY, IO::SCX, IO::BGP, IO::OBP0, IO::OBP1, IO::WY, IO::WX };
+	for (ushort address : renderRegisters)
+	{
+		m_MMU->RegisterIOWriteHook(address, &PPU::OnRenderRegisterWrite, this);
+	}
+}
+
+PPUBackend PPU::GetBackend() const
+{
+	return m_backend;
+}
+
+void PPU::SetPixelFormat(PixelFormat format)
+{
+	if (m_worker != nullptr)
+	{
+		m_worker->SetPixelFormat(format);
+	}
+
+	m_pixelFormat = format;
+	m_renderer.SetPixelFormat(format);
+	m_fifoRenderer.SetPixelFormat(format);
+
+	// The old fills are in the old format, in every framebuffer
+	std::memset(m_blankLineShades, NotBlankLine, sizeof(m_blankLineShades));
+	for (FramebufferShades& saved : m_savedShades)
+	{
+		saved.framebuffer = nullptr;
+	}
+
+	ClearFramebuffer();
+}
+
+PixelFormat PPU::GetPixelFormat() const
+{
+	return m_pixelFormat;
+}
+
+const uint* PPU::GetFramebuffer() const
+{
+	return (m_pixelFormat == PixelFormat::ARGB8888) ? reinterpret_cast<const uint*>(GetPixels()) : nullptr;
+}
+
+void PPU::SetFramebuffer(uint* framebuffer)
+{
+	framebuffer = (framebuffer != nullptr) ? framebuffer : m_ownFramebuffer;
+	if (framebuffer == m_framebuffer)
+	{
+		return;
+	}
+
+	// The presenter only reads the frames it gets, so the blank lines filled in a triple buffer frame
+	// are still there when the frame comes back as the back buffer. They don't have to be filled again
+	FramebufferShades* saved = FindSavedShades(m_framebuffer);
+	if (saved == nullptr)
+	{
+		saved = &m_savedShades[m_nextSavedShades];
+		saved->framebuffer = m_framebuffer;
+		m_nextSavedShades = (m_nextSavedShades + 1) % SavedShadeCount;
+	}
+
+	std::memcpy(saved->shades, m_blankLineShades, sizeof(m_blankLineShades));
+
+	m_framebuffer = framebuffer;
+	if (m_worker != nullptr)
+	{
+		m_worker->SetFramebuffer(reinterpret_cast<byte*>(m_framebuffer));
+	}
+
+	const FramebufferShades* restored = FindSavedShades(m_framebuffer);
+	if (restored != nullptr)
+	{
+		std::memcpy(m_blankLineShades, restored->shades, sizeof(m_blankLineShades));
+	}
+	else
+	{
+		std::memset(m_blankLineShades, NotBlankLine, sizeof(m_blankLineShades));
+	}
+
+	// A LCD that is off shows a blank screen in the new framebuffer too
+	if (!IsLCDEnabled())
+	{
+		ClearFramebuffer();
+	}
+}
+
+PPU::FramebufferShades* PPU::FindSavedShades(const uint* framebuffer)
+{
+	for (FramebufferShades& saved : m_savedShades)
+	{
+		if (saved.framebuffer == framebuffer)
+		{
+			return &saved;
+		}
+	}
+
+	return nullptr;
+}
+
+const byte* PPU::GetPixels() const
+{
+	if (m_worker != nullptr)
+	{
+		m_worker->Flush();
+	}
+
+	return reinterpret_cast<const byte*>(m_framebuffer);
+}
+
+int PPU::GetLineSize() const
+{
+	return PixelFormats::GetLineSize(m_pixelFormat);
+}
+
+ulonglong PPU::GetFramebufferHash() const
+{
+	return FrameHash::Compute(GetPixels(), GetLineSize() * LCDHeight);
+}
+
+ulong PPU::GetFrameCount() const
+{
+	return m_state->frameCount;
+}
+
+bool PPU::IsLCDEnabled() const
+{
+	return IS_BIT_SET(m_MMU->GetIORegister(IO::LCDC), LCDCBit::LCDEnable);
+}
+
+void PPU::SetRenderEnabled(bool isEnabled)
+{
+	m_isRenderRequested = isEnabled;
+}
+
+bool PPU::IsRenderingFrame() const
+{
+	return m_isRenderingFrame;
+}
+
+void PPU::SetFrameHashing(bool isEnabled)
+{
+	m_isFrameHashing = isEnabled;
+	m_hasNewFrameHash = false;
+}
+
+bool PPU::TakeFrameHash(ulong* frame, ulonglong* hash)
+{
+	if (!m_hasNewFrameHash)
+	{
+		return false;
+	}
+
+	*frame = m_hashedFrame;
+	*hash = m_frameHash;
+	m_hasNewFrameHash = false;
+
+	return true;
+}
+
+const TileCache::Stats& PPU::GetTileCacheStats() const
+{
+	return m_tileCache.GetStats();
+}
+
+void PPU::ResetStats()
+{
+	m_tileCache.ResetStats();
+}
+
+void PPU::SetColorCorrection(bool isColorCorrected)
+{
+	m_cgbColorTable = CGBColors::GetTable(isColorCorrected);
+	UpdateCGBColors();
+}
+
+const uint* PPU::GetCGBColors() const
+{
+	return m_cgbColors;
+}
+
+void PPU::OnStateLoaded()
+{
+	m_isBlankTransfer = false;
+	UpdateCGBColors();
+
+	if (m_worker != nullptr)
+	{
+		m_worker->Reset(*m_MMU->GetMemory());
+	}
+}
+
+void PPU::SetMode(Mode mode)
+{
+	m_state->mode = mode;
+
+	byte stat = m_MMU->GetIORegister(IO::STAT);
+	m_MMU->SetIORegister(IO::STAT, (stat & 0xFC) | mode);
+}
+
+void PPU::SetLY(byte ly)
+{
+	m_MMU->SetIORegister(IO::LY, ly);
+
+	byte stat = m_MMU->GetIORegister(IO::STAT);
+	if (ly == m_MMU->GetIORegister(IO::LYC))
+	{
+		stat = SET_BIT(stat, CoincidenceFlag);
+	}
+	else
+	{
+		stat = CLEAR_BIT(stat, CoincidenceFlag);
+	}
+
+	m_MMU->SetIORegister(IO::STAT, stat);
+}
+
+void PPU::UpdateStatLine()
+{
+	byte stat = m_MMU->GetIORegister(IO::STAT);
+
+	bool line = false;
+	if (IsLCDEnabled())
+	{
+		line =
+			(IS_BIT_SET(stat, CoincidenceInterruptFlag) && IS_BIT_SET(stat, CoincidenceFlag)) ||
+			(IS_BIT_SET(stat, HBlankInterruptFlag) && m_state->mode == HBlankMode) ||
+			(IS_BIT_SET(stat, VBlankInterruptFlag) && m_state->mode == VBlankMode) ||
+			(IS_BIT_SET(stat, OAMScanInterruptFlag) && m_state->mode == OAMScanMode);
+	}
+
+	if (line && !m_state->statLine)
+	{
+		m_MMU->RequestInterrupt(IO::LCDStatInterrupt);
+	}
+
+	m_state->statLine = line;
+}
+
+void PPU::RenderLine()
+{
+	PPURegisters registers = GetRegisters();
+	if (m_isRenderingFrame)
+	{
+		DrawLine(registers);
+	}
+
+	// The window line counts on the skipped frames too
+	if (ScanlineRenderer::IsWindowVisible(registers))
+	{
+		m_state->windowLine++;
+	}
+}
+
+void PPU::DrawLine(const PPURegisters& registers)
+{
+	// Boot sequences and fades spend many frames with nothing enabled. The line often still has the fill of the last frame
+	bool isBlank = (m_state->lineChangeCount == 0 && ScanlineRenderer::IsBlankLine(registers));
+	byte blankShade = isBlank ? 0 : NotBlankLine;
+	if (isBlank && m_blankLineShades[registers.ly] == blankShade)
+	{
+		return;
+	}
+
+	// The renderer fills a blank line itself. The worker may still have to draw the line of an earlier frame, so it does the fill too
+	m_blankLineShades[registers.ly] = blankShade;
+
+	if (m_worker != nullptr)
+	{
+		m_worker->Push(RenderWorker::RenderLine, registers.ly, registers.windowLine, m_scheduler->GetCycles());
+	}
+	else if (m_state->lineChangeCount == 0)
+	{
+		m_renderer.RenderLine(registers, GetLine(registers.ly));
+	}
+	else
+	{
+		// The registers changed during the line. Render it in segments from the values it started with
+		PPURegisters startRegisters = m_state->lineStartRegisters;
+		startRegisters.ly = registers.ly;
+		startRegisters.windowLine = registers.windowLine;
+		m_renderer.RenderLine(startRegisters, m_state->lineChanges, m_state->lineChangeCount, GetLine(registers.ly));
+	}
+}
+
+void PPU::FillBlankLine(byte ly, byte shade)
+{
+	if (m_blankLineShades[ly] != shade)
+	{
+		PixelFormats::Fill(m_pixelFormat, GetLine(ly), LCDWidth, shade);
+		m_blankLineShades[ly] = shade;
+	}
+}
+
+void PPU::ClearFramebuffer()
+{
+	bool isClear = true;
+	for (int ly = 0; ly < LCDHeight; ly++)
+	{
+		isClear = isClear && (m_blankLineShades[ly] == 0);
+	}
+
+	if (isClear)
+	{
+		return;
+	}
+
+	if (m_worker != nullptr)
+	{
+		m_worker->Flush();
+	}
+
+	PixelFormats::Fill(m_pixelFormat, reinterpret_cast<byte*>(m_framebuffer), LCDWidth * LCDHeight, 0);
+	std::memset(m_blankLineShades, 0, sizeof(m_blankLineShades));
+}
+
+void PPU::EndFIFOLine(byte ly)
+{
+	if (!m_isRenderingFrame)
+	{
+		return;
+	}
+
+	if (m_isBlankTransfer)
+	{
+		FillBlankLine(ly, 0);
+	}
+	else
+	{
+		m_blankLineShades[ly] = NotBlankLine;
+	}
+}
+
+void PPU::UpdateCGBColor(bool isSprite, int index)
+{
+	const byte* paletteRAM = isSprite ? m_state->spritePaletteRAM : m_state->backgroundPaletteRAM;
+	ushort color = (paletteRAM[index * 2] | (paletteRAM[index * 2 + 1] << 8)) & 0x7FFF;
+	m_cgbColors[(isSprite ? CGBColorCount / 2 : 0) + index] = m_cgbColorTable[color];
+}
+
+void PPU::UpdateCGBColors()
+{
+	for (int i = 0; i < CGBColorCount / 2; i++)
+	{
+		UpdateCGBColor(false, i);
+		UpdateCGBColor(true, i);
+	}
+}
+
+byte* PPU::GetLine(byte ly)
+{
+	return reinterpret_cast<byte*>(m_framebuffer) + ly * GetLineSize();
+}
+
+void PPU::BeginFrame()
+{
+	m_isRenderingFrame = m_isRenderRequested;
+}
+
+void PPU::CatchUp()
+{
+	if (m_backend != PPUBackend::PixelFIFO || m_state->mode != TransferMode)
+	{
+		return;
+	}
+
+	ulonglong dots = m_scheduler->GetCycles() - m_state->transferStartCycles;
+	byte ly = m_MMU->GetIORegister(IO::LY);
+	m_fifoRenderer.Run((dots < 0xFFFF) ? (ushort)dots : 0xFFFF, (m_isRenderingFrame && !m_isBlankTransfer) ? GetLine(ly) : nullptr);
+}
+
+void PPU::OnRenderRegisterChange(ushort address, byte value)
+{
+	CatchUp();
+
+	if (m_isBlankTransfer && m_state->mode == TransferMode)
+	{
+		// The line may not be blank from here on. The pixels so far have the blank shade, and the FIFO draws the rest
+		byte ly = m_MMU->GetIORegister(IO::LY);
+		FillBlankLine(ly, 0);
+		m_blankLineShades[ly] = NotBlankLine;
+		m_isBlankTransfer = false;
+	}
+
+	// The changes of a line that isn't drawn don't need to be logged. The worker still gets them as plain writes.
+	// Turning the LCD off ends the line without drawing it, so the worker must not keep that write for the next line
+	bool isLCDTurnedOff = (address == IO::LCDC && !IS_BIT_SET(value, LCDCBit::LCDEnable));
+	bool isMidLine = (m_state->mode == TransferMode && m_backend != PPUBackend::PixelFIFO && m_isRenderingFrame && !isLCDTurnedOff);
+	if (isMidLine && m_worker != nullptr)
+	{
+		// The worker keeps the log of the line itself. The pixel goes in the high byte of the address
+		ushort entryAddress = (GetTransferPixel() << 8) | (address & 0xFF);
+		m_worker->Push(RenderWorker::LineRegisterWrite, entryAddress, value, m_scheduler->GetCycles());
+
+		// Only counted, for the blank line check
+		if (m_state->lineChangeCount < MaxLineRegisterChanges)
+		{
+			m_state->lineChangeCount++;
+		}
+	}
+	else if (isMidLine)
+	{
+		if (m_state->lineChangeCount == 0)
+		{
+			m_state->lineStartRegisters = GetRegisters();
+		}
+
+		if (m_state->lineChangeCount < MaxLineRegisterChanges)
+		{
+			RegisterChange& change = m_state->lineChanges[m_state->lineChangeCount++];
+			change.x = GetTransferPixel();
+			change.address = address & 0xFF;
+			change.value = value;
+		}
+	}
+	else if (m_worker != nullptr)
+	{
+		m_worker->Push(RenderWorker::RegisterWrite, address, value, m_scheduler->GetCycles());
+	}
+}
+
+byte PPU::GetTransferPixel() const
+{
+	// The first pixel comes out after the first tile fetches, and the fine scroll discards some more
+	const ulonglong firstPixelCycles = PixelFIFORenderer::MinimumDots - LCDWidth;
+
+	ulonglong dots = m_scheduler->GetCycles() - m_state->transferStartCycles;
+	ulonglong startDots = firstPixelCycles + m_state->fineScroll;
+	if (dots <= startDots)
+	{
+		return 0;
+	}
+
+	return (dots - startDots < LCDWidth) ? (byte)(dots - startDots) : LCDWidth;
+}
+
+ulong PPU::BeginTransfer(ulong lateCycles)
+{
+	SetMode(TransferMode);
+	m_state->transferStartCycles = m_scheduler->GetCycles() - lateCycles;
+	m_state->fineScroll = m_MMU->GetIORegister(IO::SCX) % 8;
+	m_state->lineChangeCount = 0;
+
+	if (m_worker != nullptr && m_isRenderingFrame)
+	{
+		m_worker->Push(RenderWorker::BeginLine, 0, 0, m_scheduler->GetCycles());
+	}
+
+	if (m_backend != PPUBackend::PixelFIFO)
+	{
+		return TransferCycles;
+	}
+
+	m_fifoRenderer.BeginLine(m_MMU->GetIORegister(IO::LY), m_state->windowLine);
+	m_isBlankTransfer = m_isRenderingFrame && ScanlineRenderer::IsBlankLine(GetRegisters());
+
+	return m_fifoRenderer.GetMinimumDotsLeft();
+}
+
+PPURegisters PPU::GetRegisters() const
+{
+	PPURegisters registers;
+	registers.lcdc = m_MMU->GetIORegister(IO::LCDC);
+	registers.scy = m_MMU->GetIORegister(IO::SCY);
+	registers.scx = m_MMU->GetIORegister(IO::SCX);
+	registers.ly = m_MMU->GetIORegister(IO::LY);
+	registers.wy = m_MMU->GetIORegister(IO::WY);
+	registers.wx = m_MMU->GetIORegister(IO::WX);
+	registers.bgp = m_MMU->GetIORegister(IO::BGP);
+	registers.obp0 = m_MMU->GetIORegister(IO::OBP0);
+	registers.obp1 = m_MMU->GetIORegister(IO::OBP1);
+	registers.windowLine = m_state->windowLine;
+
+	return registers;
+}
+
+void PPU::EnableLCD()
+{
+	BeginFrame();
+	m_state->windowLine = 0;
+	SetLY(0);
+	SetMode(OAMScanMode);
+	UpdateStatLine();
+
+	m_scheduler->Schedule(SchedulerEvent::PPUModeEnd, OAMScanCycles);
+}
+
+void PPU::DisableLCD()
+{
+	m_scheduler->Cancel(SchedulerEvent::PPUModeEnd);
+
+	SetLY(0);
+	SetMode(HBlankMode);
+	m_state->statLine = false;
+
+	// The screen is blank while the LCD is off
+	ClearFramebuffer();
+}
+
+void PPU::OnModeEnd(void* context, ulong lateCycles)
+{
+	PPU* ppu = static_cast<PPU*>(context);
+	State* state = ppu->m_state;
+	byte ly = ppu->m_MMU->GetIORegister(IO::LY);
+
+	// The next mode starts when the previous one was due, not when the event ran
+	ulong nextCycles = 0;
+	switch (state->mode)
+	{
+	case OAMScanMode:
+		nextCycles = ppu->BeginTransfer(lateCycles);
+		break;
+
+	case TransferMode:
+		if (ppu->m_backend == PPUBackend::PixelFIFO)
+		{
+			// The length of the transfer mode isn't known in advance. Check again when it can be done at the earliest
+			ppu->CatchUp();
+			if (!ppu->m_fifoRenderer.IsLineDone())
+			{
+				ppu->m_scheduler->Schedule(SchedulerEvent::PPUModeEnd, ppu->m_fifoRenderer.GetMinimumDotsLeft());
+				return;
+			}
+
+			// The line may have finished before the event ran. HBlank takes the rest of the line
+			ushort transferDots = ppu->m_fifoRenderer.GetDots();
+			lateCycles = (ulong)(ppu->m_scheduler->GetCycles() - ppu->m_state->transferStartCycles) - transferDots;
+			nextCycles = LineCycles - OAMScanCycles - transferDots;
+
+			if (ppu->m_fifoRenderer.IsWindowUsed())
+			{
+				state->windowLine++;
+			}
+
+			ppu->EndFIFOLine(ly);
+
+			ppu->SetMode(HBlankMode);
+		}
+		else
+		{
+			ppu->SetMode(HBlankMode);
+			ppu->RenderLine();
+			nextCycles = HBlankCycles;
+		}
+
+		ppu->m_MMU->OnHBlank();
+		break;
+
+	case HBlankMode:
+		ly++;
+		ppu->SetLY(ly);
+		if (ly == LCDHeight)
+		{
+			ppu->SetMode(VBlankMode);
+			ppu->m_MMU->RequestInterrupt(IO::VBlankInterrupt);
+			state->frameCount++;
+			nextCycles = LineCycles;
+
+			if (ppu->m_isFrameHashing && ppu->m_isRenderingFrame)
+			{
+				ppu->m_frameHash = ppu->GetFramebufferHash();
+				ppu->m_hashedFrame = state->frameCount;
+				ppu->m_hasNewFrameHash = true;
+			}
+		}
+		else
+		{
+			ppu->SetMode(OAMScanMode);
+			nextCycles = OAMScanCycles;
+		}
+		break;
+
+	case VBlankMode:
+		ly++;
+		if (ly == LineCount)
+		{
+			ly = 0;
+			state->windowLine = 0;
+			ppu->BeginFrame();
+			ppu->SetLY(ly);
+			ppu->SetMode(OAMScanMode);
+			nextCycles = OAMScanCycles;
+		}
+		else
+		{
+			ppu->SetLY(ly);
+			nextCycles = LineCycles;
+		}
+		break;
+	}
+
+	ppu->UpdateStatLine();
+
+	ppu->m_scheduler->Schedule(SchedulerEvent::PPUModeEnd, (lateCycles < nextCycles) ? nextCycles - lateCycles : 0);
+}
+
+byte PPU::OnLCDCWrite(void* context, ushort address, byte value)
+{
+	PPU* ppu = static_cast<PPU*>(context);
+	ppu->OnRenderRegisterChange(address, value);
+
+	bool wasEnabled = ppu->IsLCDEnabled();
+	ppu->m_MMU->SetIORegister(IO::LCDC, value);
+
+	bool isEnabled = IS_BIT_SET(value, LCDCBit::LCDEnable);
+	if (wasEnabled && !isEnabled)
+	{
+		ppu->DisableLCD();
+	}
+	else if (!wasEnabled && isEnabled)
+	{
+		ppu->EnableLCD();
+	}
+
+	return value;
+}
+
+byte PPU::OnSTATWrite(void* context, ushort address, byte value)
+{
+	PPU* ppu = static_cast<PPU*>(context);
+
+	// Only the interrupt selection bits are writable
+	byte stat = ppu->m_MMU->GetIORegister(IO::STAT);
+	stat = 0x80 | (value & 0x78) | (stat & 0x07);
+
+	ppu->m_MMU->SetIORegister(IO::STAT, stat);
+	ppu->UpdateStatLine();
+
+	return stat;
+}
+
+byte PPU::OnLYWrite(void* context, ushort address, byte value)
+{
+	PPU* ppu = static_cast<PPU*>(context);
+
+	// LY is read only
+	return ppu->m_MMU->GetIORegister(IO::LY);
+}
+
+byte PPU::OnLYCWrite(void* context, ushort address, byte value)
+{
+	PPU* ppu = static_cast<PPU*>(context);
+	ppu->m_MMU->SetIORegister(IO::LYC, value);
+
+	if (ppu->IsLCDEnabled())
+	{
+		ppu->SetLY(ppu->m_MMU->GetIORegister(IO::LY));
+		ppu->UpdateStatLine();
+	}
+
+	return value;
+}
+
+byte PPU::OnRenderRegisterWrite(void* context, ushort address, byte value)
+{
+	PPU* ppu = static_cast<PPU*>(context);
+
+	// The pixels before the write use the old value
+	ppu->OnRenderRegisterChange(address, value);
+
+	return value;
+}
+
+byte PPU::OnPaletteIndexWrite(void* context, ushort address, byte value)
+{
+	// Bit 6 doesn't exist and reads as 1
+	return value | 0x40;
+}
+
+byte PPU::OnPaletteDataRead(void* context, ushort address, byte value)
+{
+	PPU* ppu = static_cast<PPU*>(context);
+
+	// The palette RAM can't be accessed while the LCD is reading it
+	if (ppu->m_state->mode == TransferMode && ppu->IsLCDEnabled())
+	{
+		return 0xFF;
+	}
+
+	bool isSprite = (address == IO::OCPD);
+	byte index = ppu->m_MMU->GetIORegister(isSprite ? IO::OCPS : IO::BCPS) & PaletteIndexMask;
+
+	return isSprite ? ppu->m_state->spritePaletteRAM[index] : ppu->m_state->backgroundPaletteRAM[index];
+}
+
+byte PPU::OnPaletteDataWrite(void* context, ushort address, byte value)
+{
+	PPU* ppu = static_cast<PPU*>(context);
+	bool isSprite = (address == IO::OCPD);
+	ushort indexAddress = isSprite ? IO::OCPS : IO::BCPS;
+	byte indexRegister = ppu->m_MMU->GetIORegister(indexAddress);
+	byte index = indexRegister & PaletteIndexMask;
+
+	// The write is dropped while the LCD is reading the palettes, but the index still increments
+	if (ppu->m_state->mode != TransferMode || !ppu->IsLCDEnabled())
+	{
+		byte* paletteRAM = isSprite ? ppu->m_state->spritePaletteRAM : ppu->m_state->backgroundPaletteRAM;
+		paletteRAM[index] = value;
+		ppu->UpdateCGBColor(isSprite, index / 2);
+	}
+
+	if (IS_BIT_SET(indexRegister, PaletteAutoIncrementFlag))
+	{
+		ppu->m_MMU->SetIORegister(indexAddress, (indexRegister & ~PaletteIndexMask) | ((index + 1) & PaletteIndexMask));
+	}
+
+	return value;
+}
+
+void PPU::OnVideoMemoryWrite(void* context, ushort address, byte bank, byte value)
+{
+	PPU* ppu = static_cast<PPU*>(context);
+	if (address < MMU::OAMStart)
+	{
+		ushort offset = bank * MMU::VRAMBankSize + (address - MMU::VRAMStart);
+		ppu->m_worker->Push(RenderWorker::VRAMWrite, offset, value, ppu->m_scheduler->GetCycles());
+	}
+	else
+	{
+		ppu->m_worker->Push(RenderWorker::OAMWrite, address - MMU::OAMStart, value, ppu->m_scheduler->GetCycles());
+	}
+}
@@ -0,0 +1,271 @@
+#pragma once
+
+#include "PCH.h"
+#include "PixelFormat.h"
+#include "PixelFIFORenderer.h"
+#include "PPURegisters.h"
+#include "RenderWorker.h"
+#include "ScanlineRenderer.h"
+#include "SpriteBuckets.h"
+#include "TileCache.h"
+
+class MMU;
+class Scheduler;
+class StateArena;
+
+enum class PPUBackend : byte
+{
+	Scanline, // Renders a whole line when it enters HBlank. Fast, but changes in the middle of a line are missed
+	PixelFIFO, // Renders dot by dot like the hardware. For the accuracy tests
+	ThreadedScanline // The scanline renderer on a worker thread. Same output as Scanline
+};
+
+/**
+* The picture processing unit. Runs the LCD modes on the scheduler and renders each line into the framebuffer
+* when the line enters HBlank.
+*/
+class PPU
+{
+public:
+	// The LCD modes, as they appear in STAT
+	enum Mode : byte
+	{
+		HBlankMode = 0,
+		VBlankMode = 1,
+		OAMScanMode = 2,
+		TransferMode = 3
+	};
+
+	static const ulong OAMScanCycles;
+	static const ulong TransferCycles;
+	static const ulong HBlankCycles;
+	static const ulong LineCycles;
+	static const int LineCount; // Including the VBlank lines
+
+	// CGB palette RAM. 8 palettes of 4 colors for the background, and as many for the sprites
+	static const int CGBPaletteRAMSize = 64; // 2 bytes per color
+	static const int CGBColorCount = CGBPaletteRAMSize; // Converted colors, the background colors first
+
+	/** The mode and line state. Lives in the state arena */
+	struct State
+	{
+		byte mode;
+		byte windowLine;
+		bool statLine; // The STAT interrupt is requested on the rising edge of this line
+		ulong frameCount;
+		ulonglong transferStartCycles; // When the transfer mode of the current line started
+		byte fineScroll; // SCX % 8, latched when the transfer mode starts like the renderers do
+
+		// The render register writes during the transfer mode of the current line, for the scanline backend
+		PPURegisters lineStartRegisters; // The registers before the first write
+		RegisterChange lineChanges[MaxLineRegisterChanges];
+		byte lineChangeCount; // The threaded backend only counts the writes, the worker keeps them
+
+		// The 15 bit colors, little endian. Written through BCPD and OCPD
+		byte backgroundPaletteRAM[CGBPaletteRAMSize];
+		byte spritePaletteRAM[CGBPaletteRAMSize];
+	};
+
+private:
+	// STAT bits
+	static const byte CoincidenceFlag = 2;
+	static const byte HBlankInterruptFlag = 3;
+	static const byte VBlankInterruptFlag = 4;
+	static const byte OAMScanInterruptFlag = 5;
+	static const byte CoincidenceInterruptFlag = 6;
+
+	static const byte NotBlankLine = 0xFF;
+	static const int SavedShadeCount = 4; // The 3 frames of a triple buffer and the own framebuffer
+
+	// BCPS and OCPS bits
+	static const byte PaletteIndexMask = 0x3F;
+	static const byte PaletteAutoIncrementFlag = 7;
+
+private:
+	State* m_state;
+	MMU* m_MMU;
+	Scheduler* m_scheduler;
+
+	TileCache m_tileCache;
+	SpriteBuckets m_spriteBuckets;
+	PPUBackend m_backend;
+	ScanlineRenderer m_renderer;
+	PixelFIFORenderer m_fifoRenderer; // Its state is allocated by every instance, so the state layout doesn't depend on the backend
+
+	// In the pixel format, sized for the largest one. Not part of the state, since it can always be rendered again
+	uint m_ownFramebuffer[LCDWidth * LCDHeight];
+	uint* m_framebuffer; // m_ownFramebuffer, or the one given to SetFramebuffer
+	PixelFormat m_pixelFormat;
+
+	std::unique_ptr<RenderWorker> m_worker; // Renders the lines in the threaded backend. Null otherwise
+
+	// Host settings, not part of the state. The request is latched when a frame starts, so a frame is always drawn whole or not at all
+	bool m_isRenderRequested;
+	bool m_isRenderingFrame;
+
+	// The hash of every drawn frame, taken when the frame completes. Host setting, not part of the state
+	bool m_isFrameHashing;
+	bool m_hasNewFrameHash;
+	ulong m_hashedFrame;
+	ulonglong m_frameHash;
+
+	// The shade each framebuffer line was filled with as a blank line, or NotBlankLine. A blank line that is
+	// still filled with the same shade from an earlier frame isn't drawn again. Describes the framebuffer, so it's not part of the state
+	byte m_blankLineShades[LCDHeight];
+
+	bool m_isBlankTransfer; // The pixel FIFO line is blank. It runs without output and the line is filled when it's done
+
+	// The blank line shades of the framebuffers that were drawn into before. A framebuffer that is given back
+	// to SetFramebuffer still holds its lines, so it keeps its shades too. The oldest entry is replaced
+	struct FramebufferShades
+	{
+		const uint* framebuffer;
+		byte shades[LCDHeight];
+	};
+
+	FramebufferShades m_savedShades[SavedShadeCount];
+	int m_nextSavedShades;
+
+	// The palette RAM colors converted to ARGB8888, not to the pixel format. Only the entry of a written color is converted again.
+	// A cache of the state, rebuilt when a state is loaded
+	const uint* m_cgbColorTable;
+	uint m_cgbColors[CGBColorCount];
+
+public:
+	PPU(MMU* mmu, Scheduler* scheduler, StateArena* arena, PPUBackend backend);
+
+	PPUBackend GetBackend() const;
+
+	/**
+	* Select the format the lines are rendered in. ARGB8888 by default.
+	* The renderers write the format directly, there is no conversion pass. The framebuffer is cleared to white
+	*/
+	void SetPixelFormat(PixelFormat format);
+
+	PixelFormat GetPixelFormat() const;
+
+	/** The last rendered picture, LCDWidth x LCDHeight ARGB8888 pixels. Null with the other pixel formats. Waits for the render worker to catch up */
+	const uint* GetFramebuffer() const;
+
+	/**
+	* Draw the following frames into framebuffer, which is LCDWidth x LCDHeight pixels and must stay alive until it's replaced.
+	* Null goes back to the PPU's own framebuffer. Lets a consumer hand out the buffers, like a triple buffer, without copying the frames.
+	* Call between frames. Waits for the render worker to finish the lines it has
+	*/
+	void SetFramebuffer(uint* framebuffer);
+
+	/** The last rendered picture in the pixel format, LCDHeight lines of GetLineSize() bytes. Waits for the render worker to catch up */
+	const byte* GetPixels() const;
+
+	/** The size of a framebuffer line in bytes */
+	int GetLineSize() const;
+
+	/** A 64 bit FrameHash of the framebuffer in its pixel format. All the backends must produce the same hashes for the same frames */
+	ulonglong GetFramebufferHash() const;
+
+	/** The number of frames that were completed. Increments when the LCD enters VBlank */
+	ulong GetFrameCount() const;
+
+	bool IsLCDEnabled() const;
+
+	/**
+	* Set whether the frames are drawn, starting with the next frame. A frame that isn't drawn still runs all of its timing,
+	* interrupts and STAT changes, only the pixels are skipped and the framebuffer keeps the last drawn picture.
+	*/
+	void SetRenderEnabled(bool isEnabled);
+
+	/** Whether the current frame is being drawn */
+	bool IsRenderingFrame() const;
+
+	/**
+	* Hash the framebuffer of every drawn frame when it enters VBlank. Costs a few microseconds per frame,
+	* but the threaded backend has to wait for the worker to finish the frame
+	*/
+	void SetFrameHashing(bool isEnabled);
+
+	/** The hash of the last drawn frame and its frame number. Returns false if there is no new hash since the last call */
+	bool TakeFrameHash(ulong* frame, ulonglong* hash);
+
+	/** Convert the CGB colors with the color correction of the CGB screen or without it. On by default */
+	void SetColorCorrection(bool isColorCorrected);
+
+	/**
+	* The CGB palette RAM converted to ARGB8888. The 8 background palettes of 4 colors, then the 8 sprite palettes.
+	* Always ARGB8888, whatever the pixel format. The renderers only draw DMG frames, so nothing reads it yet
+	*/
+	const uint* GetCGBColors() const;
+
+	/** Bring the render worker up to date with the state, after a snapshot was loaded */
+	void OnStateLoaded();
+
+	/** The hit rate of the decoded tiles since the last ResetStats */
+	const TileCache::Stats& GetTileCacheStats() const;
+
+	void ResetStats();
+
+private:
+	void SetMode(Mode mode);
+	void SetLY(byte ly);
+
+	/** Recompute the STAT interrupt line and request the interrupt on its rising edge */
+	void UpdateStatLine();
+
+	void RenderLine();
+
+	/** Draw the line with the backend, unless it's a blank line that the framebuffer already holds */
+	void DrawLine(const PPURegisters& registers);
+
+	/** The saved blank line shades of framebuffer, or null */
+	FramebufferShades* FindSavedShades(const uint* framebuffer);
+
+	/** Fill line ly with a shade, if it doesn't hold that fill already */
+	void FillBlankLine(byte ly, byte shade);
+
+	/** Make the whole framebuffer blank with one fill. Called when the LCD is turned off */
+	void ClearFramebuffer();
+
+	/** Called when the pixel FIFO finished line ly */
+	void EndFIFOLine(byte ly);
+
+	/** Convert the color at index (0-31) of the background or sprite palette RAM into the color cache */
+	void UpdateCGBColor(bool isSprite, int index);
+	void UpdateCGBColors();
+
+	/** The framebuffer line of ly */
+	byte* GetLine(byte ly);
+
+	/** Latch the render request for the frame that starts on line 0 */
+	void BeginFrame();
+
+	/** Run the pixel FIFO up to the current cycle. Called before the registers it reads change */
+	void CatchUp();
+
+	/** Called before a render register is written. Passes the write to the backend */
+	void OnRenderRegisterChange(ushort address, byte value);
+
+	/** The pixel the transfer mode is outputting at the current cycle */
+	byte GetTransferPixel() const;
+
+	/** Start the transfer mode. Returns the cycles until the next check whether it is done */
+	ulong BeginTransfer(ulong lateCycles);
+	PPURegisters GetRegisters() const;
+
+	void EnableLCD();
+	void DisableLCD();
+
+	static void OnModeEnd(void* context, ulong lateCycles);
+
+	static byte OnLCDCWrite(void* context, ushort address, byte value);
+	static byte OnSTATWrite(void* context, ushort address, byte value);
+	static byte OnLYWrite(void* context, ushort address, byte value);
+	static byte OnLYCWrite(void* context, ushort address, byte value);
+
+	// BCPS/BCPD and OCPS/OCPD, on the CGB
+	static byte OnPaletteIndexWrite(void* context, ushort address, byte value);
+	static byte OnPaletteDataRead(void* context, ushort address, byte value);
+	static byte OnPaletteDataWrite(void* context, ushort address, byte value);
+
+	// Hook of the registers the renderers read. Only does work in the transfer mode, outside of it a write just gets logged for the threaded backend
+	static byte OnRenderRegisterWrite(void* context, ushort address, byte value);
+	static void OnVideoMemoryWrite(void* context, ushort address, byte bank, byte value);
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "PCH.h"
+#include "IORegisters.h"
+
+const int LCDWidth = 160;
+const int LCDHeight = 144;
+
+const int SpriteCount = 40; // In OAM
+const int MaxSpritesPerLine = 10;
+
+// The colors of the DMG palette shades, as ARGB8888
+const uint DMGShades[4] = { 0xFFFFFFFF, 0xFFAAAAAA, 0xFF555555, 0xFF000000 };
+
+/** The LCD registers a scanline is rendered with */
+struct PPURegisters
+{
+	byte lcdc;
+	byte scy;
+	byte scx;
+	byte ly;
+	byte wy;
+	byte wx;
+	byte bgp;
+	byte obp0;
+	byte obp1;
+	byte windowLine; // The internal line counter of the window. Only counts the lines the window was visible on
+
+	/** Apply a write to the register at address. Ignores the registers that are not in the set */
+	void Apply(ushort address, byte value);
+};
+
+/** A register write in the middle of a line. The pixels from x on use the new value */
+struct RegisterChange
+{
+	byte x;
+	byte address; // The low byte of the register address
+	byte value;
+};
+
+// The changes of a line after this many go to the end of the line
+const int MaxLineRegisterChanges = 32;
+
+inline void PPURegisters::Apply(ushort address, byte value)
+{
+	switch (0xFF00 | address)
+	{
+	case IO::LCDC: lcdc = value; break;
+	case IO::SCY: scy = value; break;
+	case IO::SCX: scx = value; break;
+	case IO::WY: wy = value; break;
+	case IO::WX: wx = value; break;
+	case IO::BGP: bgp = value; break;
+	case IO::OBP0: obp0 = value; break;
+	case IO::OBP1: obp1 = value; break;
+	}
+}
+
+// LCDC bits
+namespace LCDCBit
+{
+	const byte BackgroundEnable = 0; // On the DMG it disables the window too
+	const byte SpriteEnable = 1;
+	const byte SpriteSize = 2; // 0 = 8x8, 1 = 8x16
+	const byte BackgroundTileMap = 3; // 0 = 0x9800, 1 = 0x9C00
+	const byte TileData = 4; // 0 = 0x8800 signed, 1 = 0x8000 unsigned
+	const byte WindowEnable = 5;
+	const byte WindowTileMap = 6; // 0 = 0x9800, 1 = 0x9C00
+	const byte LCDEnable = 7;
+}
+
+// A sprite attribute entry in OAM
+struct SpriteAttributes
+{
+	byte y; // Y position + 16
+	byte x; // X position + 8
+	byte tile;
+	byte flags;
+};
+
+// Sprite attribute flags
+namespace SpriteFlag
+{
+	const byte Palette = 4; // DMG only. 0 = OBP0, 1 = OBP1
+	const byte FlipX = 5;
+	const byte FlipY = 6;
+	const byte Priority = 7; // 1 = behind BG colors 1-3
+}
@@ -0,0 +1,335 @@
+#include <cstring>
+#include "PixelFIFORenderer.h"
+#include "BitUtil.h"
+#include "IORegisters.h"
+#include "SpriteBuckets.h"
+#include "StateArena.h"
+#include "TileCache.h"
+
+// Offsets in VRAM
+static const ushort TileMap0 = 0x1800; // 0x9800
+static const ushort TileMap1 = 0x1C00; // 0x9C00
+static const int TileMapWidth = 32;
+
+PixelFIFORenderer::PixelFIFORenderer(const byte* vram, const byte* oam, const byte* ioRegisters, TileCache* tileCache, SpriteBuckets* spriteBuckets, StateArena* arena) :
+	m_state(arena->Allocate<State>()),
+	m_vram(vram),
+	m_oam(oam),
+	m_ioRegisters(ioRegisters),
+	m_tileCache(tileCache),
+	m_spriteBuckets(spriteBuckets)
+{
+	m_state->isLineDone = true;
+	SetPixelFormat(PixelFormat::ARGB8888);
+}
+
+void PixelFIFORenderer::SetPixelFormat(PixelFormat format)
+{
+	m_format = format;
+	for (int i = 0; i < 4; i++)
+	{
+		m_shadeValues[i] = PixelFormats::GetShadeValue(format, (byte)i);
+	}
+}
+
+void PixelFIFORenderer::BeginLine(byte ly, byte windowLine)
+{
+	std::memset(m_state, 0, sizeof(State));
+	m_state->ly = ly;
+	m_state->windowLine = windowLine;
+	m_state->pendingSprite = -1;
+	m_state->startupDots = StartupDots;
+
+	// The fine scroll is latched at the start of the line
+	m_state->discardPixels = GetRegister(IO::SCX) % 8;
+
+	// OAM scan. The buckets hold the sprites the scan finds, in OAM order
+	int height = IS_BIT_SET(GetRegister(IO::LCDC), LCDCBit::SpriteSize) ? 16 : 8;
+	const SpriteBuckets::Bucket& bucket = m_spriteBuckets->GetBucket(ly, height);
+	std::memcpy(m_state->spriteIndices, bucket.sprites, bucket.count);
+	m_state->spriteCount = bucket.count;
+}
+
+void PixelFIFORenderer::Run(ushort dots, byte* line)
+{
+	while (!m_state->isLineDone && m_state->dots < dots)
+	{
+		Tick(line);
+	}
+}
+
+bool PixelFIFORenderer::IsLineDone() const
+{
+	return m_state->isLineDone;
+}
+
+ushort PixelFIFORenderer::GetDots() const
+{
+	return m_state->dots;
+}
+
+ushort PixelFIFORenderer::GetMinimumDotsLeft() const
+{
+	if (m_state->isLineDone)
+	{
+		return 0;
+	}
+
+	// At most 1 pixel is output per dot, and the first fetch can't finish before the minimum length of the line
+	ushort pixelsLeft = LCDWidth - m_state->x;
+	ushort minimumLeft = (m_state->dots < MinimumDots) ? MinimumDots - m_state->dots : 0;
+
+	return (pixelsLeft > minimumLeft) ? pixelsLeft : minimumLeft;
+}
+
+bool PixelFIFORenderer::IsWindowUsed() const
+{
+	return m_state->isFetchingWindow;
+}
+
+void PixelFIFORenderer::Tick(byte* line)
+{
+	m_state->dots++;
+
+	if (m_state->startupDots > 0)
+	{
+		m_state->startupDots--;
+		return;
+	}
+
+	// The fetcher and the output stop while a sprite is fetched
+	if (m_state->pendingSprite >= 0)
+	{
+		m_state->spriteStallDots--;
+		if (m_state->spriteStallDots == 0)
+		{
+			MergeSprite(m_state->pendingSprite);
+			m_state->pendingSprite = -1;
+		}
+
+		return;
+	}
+
+	if (m_state->discardPixels == 0 && StartSpriteFetch())
+	{
+		return;
+	}
+
+	CheckWindow();
+	TickFetcher();
+	OutputPixel(line);
+}
+
+bool PixelFIFORenderer::StartSpriteFetch()
+{
+	if (!IS_BIT_SET(GetRegister(IO::LCDC), LCDCBit::SpriteEnable))
+	{
+		return false;
+	}
+
+	// Sprites that start left of the screen are all due at the first pixel. They are fetched smallest X first,
+	// on equal X in OAM order, since the sprite fetched first wins and that is the DMG drawing priority
+	const SpriteAttributes* sprites = reinterpret_cast<const SpriteAttributes*>(m_oam);
+	int next = -1;
+	for (int i = 0; i < m_state->spriteCount; i++)
+	{
+		if ((m_state->fetchedSprites & (1 << i)) != 0)
+		{
+			continue;
+		}
+
+		int spriteX = sprites[m_state->spriteIndices[i]].x;
+		if (spriteX > m_state->x + 8)
+		{
+			continue;
+		}
+
+		// The indices are in OAM order, so the first sprite found keeps an equal X
+		if (next < 0 || spriteX < sprites[m_state->spriteIndices[next]].x)
+		{
+			next = i;
+		}
+	}
+
+	if (next < 0)
+	{
+		return false;
+	}
+
+	m_state->fetchedSprites |= 1 << next;
+	m_state->pendingSprite = (sbyte)next;
+
+	// The background fetch in progress has to finish first
+	byte fetchLeft = (m_state->fetcherDots < FetchDots) ? FetchDots - m_state->fetcherDots : 0;
+	m_state->spriteStallDots = SpriteFetchDots + fetchLeft;
+	return true;
+}
+
+void PixelFIFORenderer::MergeSprite(int sprite)
+{
+	const SpriteAttributes& attributes = reinterpret_cast<const SpriteAttributes*>(m_oam)[m_state->spriteIndices[sprite]];
+
+	int height = IS_BIT_SET(GetRegister(IO::LCDC), LCDCBit::SpriteSize) ? 16 : 8;
+	int row = m_state->ly - (attributes.y - 16);
+	if (IS_BIT_SET(attributes.flags, SpriteFlag::FlipY))
+	{
+		row = height - 1 - row;
+	}
+
+	int tile = (height == 16) ? ((attributes.tile & 0xFE) + row / 8) : attributes.tile;
+	const byte* tileRow = m_tileCache->GetTileRow(0, tile, row % 8, IS_BIT_SET(attributes.flags, SpriteFlag::FlipX));
+
+	// The sprites fetched earlier keep their pixels, which gives the DMG priority by X and then by OAM index
+	for (int i = 0; i < 8; i++)
+	{
+		int slot = attributes.x - 8 + i - m_state->x;
+		if (slot < 0 || slot >= 8 || m_state->spriteFIFO[slot] != 0)
+		{
+			continue;
+		}
+
+		m_state->spriteFIFO[slot] = tileRow[i];
+		m_state->spriteFlagsFIFO[slot] = attributes.flags;
+	}
+}
+
+void PixelFIFORenderer::CheckWindow()
+{
+	byte lcdc = GetRegister(IO::LCDC);
+	if (m_state->isFetchingWindow ||
+		!IS_BIT_SET(lcdc, LCDCBit::WindowEnable) || !IS_BIT_SET(lcdc, LCDCBit::BackgroundEnable) ||
+		m_state->ly < GetRegister(IO::WY) || m_state->discardPixels > 0)
+	{
+		return;
+	}
+
+	// WX is the window position + 7. A window that starts left of the screen starts at the first pixel
+	int windowX = GetRegister(IO::WX) - 7;
+	if (windowX > m_state->x || (windowX < m_state->x && m_state->x > 0))
+	{
+		return;
+	}
+
+	// The background pixels are thrown away and the fetcher starts over on the window
+	m_state->isFetchingWindow = true;
+	m_state->backgroundCount = 0;
+	m_state->fetcherDots = 0;
+	m_state->fetcherX = 0;
+
+	if (windowX < 0)
+	{
+		m_state->discardPixels = (byte)-windowX;
+	}
+}
+
+void PixelFIFORenderer::TickFetcher()
+{
+	if (m_state->fetcherDots < FetchDots)
+	{
+		m_state->fetcherDots++;
+	}
+
+	byte lcdc = GetRegister(IO::LCDC);
+
+	// Tile index, read with the scroll of this moment
+	if (m_state->fetcherDots == 2)
+	{
+		ushort tileMap;
+		int mapX;
+		int mapY;
+		if (m_state->isFetchingWindow)
+		{
+			tileMap = IS_BIT_SET(lcdc, LCDCBit::WindowTileMap) ? TileMap1 : TileMap0;
+			mapX = m_state->fetcherX;
+			mapY = m_state->windowLine;
+		}
+		else
+		{
+			tileMap = IS_BIT_SET(lcdc, LCDCBit::BackgroundTileMap) ? TileMap1 : TileMap0;
+			mapX = GetRegister(IO::SCX) / 8 + m_state->fetcherX;
+			mapY = (byte)(GetRegister(IO::SCY) + m_state->ly);
+		}
+
+		byte tileIndex = m_vram[tileMap + (mapY / 8) * TileMapWidth + (mapX % TileMapWidth)];
+		m_state->fetcherTile = (ushort)TileCache::GetBackgroundTile(lcdc, tileIndex);
+	}
+
+	// Tile data. Both bitplanes are taken at once from the decoded tile
+	if (m_state->fetcherDots == FetchDots - 1)
+	{
+		byte row = m_state->isFetchingWindow ? m_state->windowLine % 8 : (byte)(GetRegister(IO::SCY) + m_state->ly) % 8;
+		std::memcpy(m_state->fetcherRow, m_tileCache->GetTileRow(0, m_state->fetcherTile, row, false), 8);
+	}
+
+	// Push. The FIFO only takes a whole tile when it's empty
+	if (m_state->fetcherDots == FetchDots && m_state->backgroundCount == 0)
+	{
+		bool isBackgroundEnabled = IS_BIT_SET(lcdc, LCDCBit::BackgroundEnable);
+		for (int i = 0; i < 8; i++)
+		{
+			m_state->backgroundFIFO[(m_state->backgroundHead + i) % 16] = isBackgroundEnabled ? m_state->fetcherRow[i] : 0;
+		}
+
+		m_state->backgroundCount = 8;
+		m_state->fetcherDots = 0;
+		m_state->fetcherX++;
+	}
+}
+
+void PixelFIFORenderer::OutputPixel(byte* line)
+{
+	if (m_state->backgroundCount == 0)
+	{
+		return;
+	}
+
+	byte background = m_state->backgroundFIFO[m_state->backgroundHead];
+	m_state->backgroundHead = (m_state->backgroundHead + 1) % 16;
+	m_state->backgroundCount--;
+
+	if (m_state->discardPixels > 0)
+	{
+		m_state->discardPixels--;
+		return;
+	}
+
+	// The palettes are read when the pixel is output
+	if (line != nullptr)
+	{
+		byte sprite = m_state->spriteFIFO[0];
+		byte flags = m_state->spriteFlagsFIFO[0];
+		byte shade;
+		if (sprite != 0 && (background == 0 || !IS_BIT_SET(flags, SpriteFlag::Priority)))
+		{
+			byte palette = GetRegister(IS_BIT_SET(flags, SpriteFlag::Palette) ? IO::OBP1 : IO::OBP0);
+			shade = (palette >> (sprite * 2)) & 0x03;
+		}
+		else if (IS_BIT_SET(GetRegister(IO::LCDC), LCDCBit::BackgroundEnable))
+		{
+			shade = (GetRegister(IO::BGP) >> (background * 2)) & 0x03;
+		}
+		else
+		{
+			// On the DMG a disabled background is white, whatever BGP maps color 0 to
+			shade = 0;
+		}
+
+		PixelFormats::WritePixel(m_format, line, m_state->x, m_shadeValues[shade]);
+	}
+
+	std::memmove(m_state->spriteFIFO, m_state->spriteFIFO + 1, 7);
+	std::memmove(m_state->spriteFlagsFIFO, m_state->spriteFlagsFIFO + 1, 7);
+	m_state->spriteFIFO[7] = 0;
+	m_state->spriteFlagsFIFO[7] = 0;
+
+	m_state->x++;
+	if (m_state->x == LCDWidth)
+	{
+		m_state->isLineDone = true;
+	}
+}
+
+byte PixelFIFORenderer::GetRegister(ushort address) const
+{
+	return m_ioRegisters[address & 0xFF];
+}
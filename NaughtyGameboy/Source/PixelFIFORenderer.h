@@ -0,0 +1,115 @@
+#pragma once
+
+#include "PCH.h"
+#include "PixelFormat.h"
+#include "PPURegisters.h"
+
+class SpriteBuckets;
+class StateArena;
+class TileCache;
+
+/**
+* Renders a scanline dot by dot with the background fetcher and the pixel FIFOs of the hardware.
+* The registers are read when the hardware would read them, so changes in the middle of a line take effect at the right
+* pixel, and the length of the transfer mode depends on the fine scroll, the window and the sprites.
+* It's much slower than the ScanlineRenderer and is only used by the PPU instances that select it.
+*/
+class PixelFIFORenderer
+{
+public:
+	/** The line in progress. Lives in the state arena, so a snapshot can be taken in the middle of a line */
+	struct State
+	{
+		// Background FIFO. A ring of color indices
+		byte backgroundFIFO[16];
+		byte backgroundHead;
+		byte backgroundCount;
+
+		// Sprite FIFO. Slot 0 is the sprite pixel over the next output pixel. 0 is transparent
+		byte spriteFIFO[8];
+		byte spriteFlagsFIFO[8];
+
+		// The sprites the OAM scan found on the line, in OAM order
+		byte spriteIndices[MaxSpritesPerLine];
+		byte spriteCount;
+		ushort fetchedSprites; // One bit per found sprite
+		sbyte pendingSprite; // The sprite being fetched, -1 if none
+		byte spriteStallDots; // Dots until the sprite fetch is done
+
+		// Background fetcher
+		byte fetcherDots; // Dots spent on the current tile
+		byte fetcherX; // Tile column, counted from the start of the line or the window
+		ushort fetcherTile;
+		byte fetcherRow[8];
+		bool isFetchingWindow;
+
+		byte ly;
+		byte windowLine;
+		byte startupDots; // The first fetch of the line is thrown away
+		byte discardPixels; // The fine scroll drops the first pixels
+		byte x; // Pixels output so far
+		ushort dots; // Dots since the start of the transfer mode
+		bool isLineDone;
+	};
+
+	/** The line takes at least this many dots, even without the fine scroll and sprites */
+	static const ushort MinimumDots = 172;
+
+private:
+	static const byte FetchDots = 6; // Tile index, data low and data high, 2 dots each
+	static const byte SpriteFetchDots = 6;
+
+	// Calibrated so that a line without fine scroll, window and sprites takes the minimum length
+	static const byte StartupDots = MinimumDots - LCDWidth - (FetchDots - 1);
+
+private:
+	State* m_state;
+	const byte* m_vram;
+	const byte* m_oam;
+	const byte* m_ioRegisters; // The 0xFF page, where the LCD registers are read from
+	TileCache* m_tileCache;
+	SpriteBuckets* m_spriteBuckets;
+
+	// Not part of the state, the format is a setting of the host
+	PixelFormat m_format;
+	uint m_shadeValues[4];
+
+public:
+	PixelFIFORenderer(const byte* vram, const byte* oam, const byte* ioRegisters, TileCache* tileCache, SpriteBuckets* spriteBuckets, StateArena* arena);
+
+	/** The format of the lines that are rendered. ARGB8888 by default */
+	void SetPixelFormat(PixelFormat format);
+
+	/** Start the transfer mode of line ly. The sprites of the line are taken from the buckets right away */
+	void BeginLine(byte ly, byte windowLine);
+
+	/** Run the line until dots dots have passed since it started or it is done. The pixels are written into line, in the pixel format.
+	* A null line runs the same timing without producing the pixels */
+	void Run(ushort dots, byte* line);
+
+	bool IsLineDone() const;
+
+	/** The length of the transfer mode so far */
+	ushort GetDots() const;
+
+	/** The lower bound of the dots until the line is done */
+	ushort GetMinimumDotsLeft() const;
+
+	/** Whether the window was rendered on the line. The window line counter only advances then */
+	bool IsWindowUsed() const;
+
+private:
+	void Tick(byte* line);
+
+	/** Returns true if a sprite at the current pixel starts being fetched */
+	bool StartSpriteFetch();
+	void MergeSprite(int sprite);
+
+	/** Switch the fetcher to the window if it starts at the current pixel */
+	void CheckWindow();
+
+	void TickFetcher();
+	void OutputPixel(byte* line);
+
+	byte GetRegister(ushort address) const;
+};
@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <cstring>
+#include "PixelFormat.h"
+#include "PPURegisters.h"
+
+int PixelFormats::GetLineSize(PixelFormat format)
+{
+	switch (format)
+	{
+	case PixelFormat::Packed2bpp:
+		return LCDWidth / 4;
+
+	case PixelFormat::Index8:
+	case PixelFormat::Gray8:
+		return LCDWidth;
+
+	case PixelFormat::RGB565:
+		return LCDWidth * 2;
+
+	default:
+		return LCDWidth * 4;
+	}
+}
+
+uint PixelFormats::GetShadeValue(PixelFormat format, byte shade)
+{
+	uint color = DMGShades[shade & 0x03];
+	byte red = (color >> 16) & 0xFF;
+	byte green = (color >> 8) & 0xFF;
+	byte blue = color & 0xFF;
+
+	switch (format)
+	{
+	case PixelFormat::Packed2bpp:
+	case PixelFormat::Index8:
+		return shade & 0x03;
+
+	case PixelFormat::Gray8:
+		// The DMG shades are grays. Weighted like the luma anyway, in case they get tinted
+		return GetLuma(color);
+
+	case PixelFormat::RGB565:
+		return ((red >> 3) << 11) | ((green >> 2) << 5) | (blue >> 3);
+
+	default:
+		return color;
+	}
+}
+
+void PixelFormats::MapPalette(PixelFormat format, const byte* indices, const uint* palette, byte* line, int x, int count)
+{
+	int endX = x + count;
+	switch (format)
+	{
+	case PixelFormat::Packed2bpp:
+		// The partial bytes at the ends keep the pixels of their neighbours, the whole bytes in between are packed at once
+		for (; x < endX && x % 4 != 0; x++)
+		{
+			WritePixel(format, line, x, palette[*indices++]);
+		}
+
+		for (; x + 4 <= endX; x += 4)
+		{
+			line[x / 4] = (byte)((palette[indices[0]] << 6) | (palette[indices[1]] << 4) | (palette[indices[2]] << 2) | palette[indices[3]]);
+			indices += 4;
+		}
+
+		for (; x < endX; x++)
+		{
+			WritePixel(format, line, x, palette[*indices++]);
+		}
+		break;
+
+	case PixelFormat::Index8:
+	case PixelFormat::Gray8:
+		for (; x < endX; x++)
+		{
+			line[x] = (byte)palette[*indices++];
+		}
+		break;
+
+	case PixelFormat::RGB565:
+	{
+		ushort* pixels = reinterpret_cast<ushort*>(line);
+		for (; x < endX; x++)
+		{
+			pixels[x] = (ushort)palette[*indices++];
+		}
+		break;
+	}
+
+	default:
+	{
+		uint* pixels = reinterpret_cast<uint*>(line);
+		for (; x < endX; x++)
+		{
+			pixels[x] = palette[*indices++];
+		}
+		break;
+	}
+	}
+}
+
+void PixelFormats::Fill(PixelFormat format, byte* pixels, int pixelCount, byte shade)
+{
+	uint value = GetShadeValue(format, shade);
+	switch (format)
+	{
+	case PixelFormat::Packed2bpp:
+		// The same shade in all 4 pixels of a byte
+		std::memset(pixels, (int)(value * 0x55), pixelCount / 4);
+		for (int i = pixelCount / 4 * 4; i < pixelCount; i++)
+		{
+			WritePixel(format, pixels, i, value);
+		}
+		break;
+
+	case PixelFormat::Index8:
+	case PixelFormat::Gray8:
+		std::memset(pixels, (int)value, pixelCount);
+		break;
+
+	case PixelFormat::RGB565:
+		std::fill_n(reinterpret_cast<ushort*>(pixels), pixelCount, (ushort)value);
+		break;
+
+	default:
+		std::fill_n(reinterpret_cast<uint*>(pixels), pixelCount, value);
+		break;
+	}
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "PCH.h"
+
+/**
+* The layouts the PPU can write the framebuffer in. The lines follow each other without padding.
+* The smaller formats are for the consumers that don't need colors, they cut the memory traffic of a frame by up to 16x.
+*/
+enum class PixelFormat : byte
+{
+	Packed2bpp, // The shade numbers (0 is white, 3 is black), 4 pixels per byte. The leftmost pixel is in the top bits
+	Index8, // The shade numbers, a byte per pixel
+	Gray8, // 255 is white, 0 is black
+	RGB565,
+	ARGB8888,
+
+	Count
+};
+
+namespace PixelFormats
+{
+	/** The size of a line in bytes */
+	int GetLineSize(PixelFormat format);
+
+	/** The luma of an ARGB8888 color, with the BT.601 weights in 8 bit fixed point. Every conversion to gray uses it */
+	inline byte GetLuma(uint color)
+	{
+		uint red = (color >> 16) & 0xFF;
+		uint green = (color >> 8) & 0xFF;
+		uint blue = color & 0xFF;
+
+		// The weights add up to 256, so a gray keeps its exact level
+		return (byte)((red * 77 + green * 150 + blue * 29 + 128) >> 8);
+	}
+
+	/** The value that a shade (0-3) is stored as */
+	uint GetShadeValue(PixelFormat format, byte shade);
+
+	/** Store value, which is the value of a shade in the format, at pixel x of line */
+	inline void WritePixel(PixelFormat format, byte* line, int x, uint value)
+	{
+		switch (format)
+		{
+		case PixelFormat::Packed2bpp:
+		{
+			int shift = 6 - (x % 4) * 2;
+			line[x / 4] = (byte)((line[x / 4] & ~(0x03 << shift)) | (value << shift));
+			break;
+		}
+
+		case PixelFormat::Index8:
+		case PixelFormat::Gray8:
+			line[x] = (byte)value;
+			break;
+
+		case PixelFormat::RGB565:
+			reinterpret_cast<ushort*>(line)[x] = (ushort)value;
+			break;
+
+		default:
+			reinterpret_cast<uint*>(line)[x] = value;
+			break;
+		}
+	}
+
+	/**
+	* Map count color indices through a palette of shade values in the format, and store them from pixel x of line on.
+	* Every index must be in the palette
+	*/
+	void MapPalette(PixelFormat format, const byte* indices, const uint* palette, byte* line, int x, int count);
+
+	/** Fill pixelCount pixels with the value of a shade */
+	void Fill(PixelFormat format, byte* pixels, int pixelCount, byte shade);
+}
@@ -0,0 +1,259 @@
+#include "PixelKernels.h"
+#include "CPUFeatures.h"
+#include "BitUtil.h"
+#include "PPURegisters.h"
+
+#if HAS_X86_SIMD
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+static void DecodeTileRowsScalar(const byte* data, byte* indices, int rowCount)
+{
+	for (int row = 0; row < rowCount; row++)
+	{
+		byte low = data[row * 2];
+		byte high = data[row * 2 + 1];
+
+		for (int x = 0; x < 8; x++)
+		{
+			int bit = 7 - x;
+			indices[row * 8 + x] = (byte)(((low >> bit) & 1) | (((high >> bit) & 1) << 1));
+		}
+	}
+}
+
+// The reference the SIMD compositors are verified against
+static void ComposeLineScalar(const byte* background, const byte* sprites, const byte* spriteFlags, byte* colors, int count)
+{
+	for (int x = 0; x < count; x++)
+	{
+		byte sprite = sprites[x];
+		if (sprite != 0 && (background[x] == 0 || !IS_BIT_SET(spriteFlags[x], SpriteFlag::Priority)))
+		{
+			colors[x] = (IS_BIT_SET(spriteFlags[x], SpriteFlag::Palette) ? PixelKernels::Sprite1Colors : PixelKernels::Sprite0Colors) + sprite;
+		}
+		else
+		{
+			colors[x] = background[x];
+		}
+	}
+}
+
+static void MapPaletteScalar(const byte* indices, const uint* palette, int paletteSize, uint* pixels, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		pixels[i] = palette[indices[i]];
+	}
+}
+
+#if HAS_X86_SIMD
+/** The bitplane bytes of 8 rows, split into the low planes and the high planes (bytes 0-7 of each) */
+static void SplitBitplanes(const byte* data, __m128i* lows, __m128i* highs)
+{
+	__m128i rows = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+	*lows = _mm_packus_epi16(_mm_and_si128(rows, _mm_set1_epi16(0x00FF)), _mm_setzero_si128());
+	*highs = _mm_packus_epi16(_mm_srli_epi16(rows, 8), _mm_setzero_si128());
+}
+
+/** The color indices of 2 rows, from their bitplane bytes repeated 8 times each */
+static __m128i DecodeTwoRowsSSE2(__m128i lows, __m128i highs)
+{
+	// Each byte tests the bit of its pixel. Bit 7 is the leftmost pixel
+	const __m128i bits = _mm_set_epi8(1, 2, 4, 8, 16, 32, 64, (char)0x80, 1, 2, 4, 8, 16, 32, 64, (char)0x80);
+
+	__m128i low = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(lows, bits), bits), _mm_set1_epi8(1));
+	__m128i high = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(highs, bits), bits), _mm_set1_epi8(2));
+
+	return _mm_or_si128(low, high);
+}
+
+static void DecodeTileRowsSSE2(const byte* data, byte* indices, int rowCount)
+{
+	int row = 0;
+	for (; row + 8 <= rowCount; row += 8)
+	{
+		__m128i lows, highs;
+		SplitBitplanes(data + row * 2, &lows, &highs);
+
+		// Repeat every byte 8 times: 0 0 1 1 .. -> 0 0 0 0 1 1 1 1 .. -> 0 x8 1 x8
+		__m128i lows16 = _mm_unpacklo_epi8(lows, lows);
+		__m128i highs16 = _mm_unpacklo_epi8(highs, highs);
+		__m128i lows32[2] = { _mm_unpacklo_epi16(lows16, lows16), _mm_unpackhi_epi16(lows16, lows16) };
+		__m128i highs32[2] = { _mm_unpacklo_epi16(highs16, highs16), _mm_unpackhi_epi16(highs16, highs16) };
+
+		__m128i* output = reinterpret_cast<__m128i*>(indices + row * 8);
+		for (int i = 0; i < 2; i++)
+		{
+			__m128i rows0 = DecodeTwoRowsSSE2(_mm_unpacklo_epi32(lows32[i], lows32[i]), _mm_unpacklo_epi32(highs32[i], highs32[i]));
+			__m128i rows1 = DecodeTwoRowsSSE2(_mm_unpackhi_epi32(lows32[i], lows32[i]), _mm_unpackhi_epi32(highs32[i], highs32[i]));
+			_mm_storeu_si128(output + i * 2, rows0);
+			_mm_storeu_si128(output + i * 2 + 1, rows1);
+		}
+	}
+
+	DecodeTileRowsScalar(data + row * 2, indices + row * 8, rowCount - row);
+}
+
+// Builds the masks of the layer rules for 16 pixels and selects between the background and the sprite colors without branches
+static void ComposeLineSSE2(const byte* background, const byte* sprites, const byte* spriteFlags, byte* colors, int count)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i paletteBit = _mm_set1_epi8(1 << SpriteFlag::Palette);
+	const __m128i sprite0Colors = _mm_set1_epi8(PixelKernels::Sprite0Colors);
+	const __m128i paletteOffset = _mm_set1_epi8(PixelKernels::Sprite1Colors - PixelKernels::Sprite0Colors);
+
+	int x = 0;
+	for (; x + 16 <= count; x += 16)
+	{
+		__m128i backgroundPixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(background + x));
+		__m128i spritePixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sprites + x));
+		__m128i flags = _mm_loadu_si128(reinterpret_cast<const __m128i*>(spriteFlags + x));
+
+		// The priority flag is bit 7, so the sprite is in front when the flags are positive as signed bytes
+		__m128i isTransparent = _mm_cmpeq_epi8(spritePixels, zero);
+		__m128i isBackgroundClear = _mm_cmpeq_epi8(backgroundPixels, zero);
+		__m128i isSpriteInFront = _mm_or_si128(isBackgroundClear, _mm_cmpgt_epi8(flags, _mm_set1_epi8(-1)));
+		__m128i isSpriteDrawn = _mm_andnot_si128(isTransparent, isSpriteInFront);
+
+		__m128i isPalette1 = _mm_cmpeq_epi8(_mm_and_si128(flags, paletteBit), paletteBit);
+		__m128i spriteColors = _mm_add_epi8(_mm_add_epi8(spritePixels, sprite0Colors), _mm_and_si128(isPalette1, paletteOffset));
+
+		__m128i result = _mm_or_si128(_mm_and_si128(isSpriteDrawn, spriteColors), _mm_andnot_si128(isSpriteDrawn, backgroundPixels));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(colors + x), result);
+	}
+
+	ComposeLineScalar(background + x, sprites + x, spriteFlags + x, colors + x, count - x);
+}
+
+TARGET_AVX2 static void DecodeTileRowsAVX2(const byte* data, byte* indices, int rowCount)
+{
+	// Bytes 0-7 of the source repeated 8 times each. The shuffle works per 128 bit lane, so the high lane takes rows 2-3 (6-7)
+	const __m256i repeatRows0123 = _mm256_setr_epi8(
+		0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+		2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+	const __m256i repeatRows4567 = _mm256_setr_epi8(
+		4, 4, 4, 4, 4, 4, 4, 4, 5, 5, 5, 5, 5, 5, 5, 5,
+		6, 6, 6, 6, 6, 6, 6, 6, 7, 7, 7, 7, 7, 7, 7, 7);
+	const __m256i bits = _mm256_setr_epi8(
+		(char)0x80, 64, 32, 16, 8, 4, 2, 1, (char)0x80, 64, 32, 16, 8, 4, 2, 1,
+		(char)0x80, 64, 32, 16, 8, 4, 2, 1, (char)0x80, 64, 32, 16, 8, 4, 2, 1);
+	const __m256i ones = _mm256_set1_epi8(1);
+	const __m256i twos = _mm256_set1_epi8(2);
+
+	int row = 0;
+	for (; row + 8 <= rowCount; row += 8)
+	{
+		__m128i lows, highs;
+		SplitBitplanes(data + row * 2, &lows, &highs);
+		__m256i lows256 = _mm256_broadcastsi128_si256(lows);
+		__m256i highs256 = _mm256_broadcastsi128_si256(highs);
+
+		__m256i* output = reinterpret_cast<__m256i*>(indices + row * 8);
+		const __m256i repeats[2] = { repeatRows0123, repeatRows4567 };
+		for (int i = 0; i < 2; i++)
+		{
+			__m256i low = _mm256_shuffle_epi8(lows256, repeats[i]);
+			__m256i high = _mm256_shuffle_epi8(highs256, repeats[i]);
+			low = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(low, bits), bits), ones);
+			high = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(high, bits), bits), twos);
+
+			_mm256_storeu_si256(output + i, _mm256_or_si256(low, high));
+		}
+	}
+
+	DecodeTileRowsScalar(data + row * 2, indices + row * 8, rowCount - row);
+}
+
+TARGET_AVX2 static void ComposeLineAVX2(const byte* background, const byte* sprites, const byte* spriteFlags, byte* colors, int count)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i paletteBit = _mm256_set1_epi8(1 << SpriteFlag::Palette);
+	const __m256i sprite0Colors = _mm256_set1_epi8(PixelKernels::Sprite0Colors);
+	const __m256i paletteOffset = _mm256_set1_epi8(PixelKernels::Sprite1Colors - PixelKernels::Sprite0Colors);
+
+	int x = 0;
+	for (; x + 32 <= count; x += 32)
+	{
+		__m256i backgroundPixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(background + x));
+		__m256i spritePixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(sprites + x));
+		__m256i flags = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(spriteFlags + x));
+
+		__m256i isTransparent = _mm256_cmpeq_epi8(spritePixels, zero);
+		__m256i isBackgroundClear = _mm256_cmpeq_epi8(backgroundPixels, zero);
+		__m256i isSpriteInFront = _mm256_or_si256(isBackgroundClear, _mm256_cmpgt_epi8(flags, _mm256_set1_epi8(-1)));
+		__m256i isSpriteDrawn = _mm256_andnot_si256(isTransparent, isSpriteInFront);
+
+		__m256i isPalette1 = _mm256_cmpeq_epi8(_mm256_and_si256(flags, paletteBit), paletteBit);
+		__m256i spriteColors = _mm256_add_epi8(_mm256_add_epi8(spritePixels, sprite0Colors), _mm256_and_si256(isPalette1, paletteOffset));
+
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(colors + x), _mm256_blendv_epi8(backgroundPixels, spriteColors, isSpriteDrawn));
+	}
+
+	// The rest of a 160 pixel line
+	ComposeLineSSE2(background + x, sprites + x, spriteFlags + x, colors + x, count - x);
+}
+
+TARGET_AVX2 static void MapPaletteAVX2(const byte* indices, const uint* palette, int paletteSize, uint* pixels, int count)
+{
+	int i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(indices + i)));
+		__m256i colors = _mm256_i32gather_epi32(reinterpret_cast<const int*>(palette), index, 4);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(pixels + i), colors);
+	}
+
+	MapPaletteScalar(indices + i, palette, paletteSize, pixels + i, count - i);
+}
+#endif
+
+static const PixelKernels ScalarKernels = { "Scalar", &DecodeTileRowsScalar, &ComposeLineScalar, &MapPaletteScalar };
+
+#if HAS_X86_SIMD
+// SSE2 has no gather and no byte shuffle. Emulating the table lookup with compares and selects
+// was several times slower than the scalar loop in the benchmark, so the SSE2 set maps palettes the scalar way
+static const PixelKernels SSE2Kernels = { "SSE2", &DecodeTileRowsSSE2, &ComposeLineSSE2, &MapPaletteScalar };
+static const PixelKernels AVX2Kernels = { "AVX2", &DecodeTileRowsAVX2, &ComposeLineAVX2, &MapPaletteAVX2 };
+#endif
+
+static const PixelKernels& SelectBestKernels()
+{
+	for (int set = (int)PixelKernelSet::Count - 1; set > 0; set--)
+	{
+		const PixelKernels* kernels = PixelKernels::Get((PixelKernelSet)set);
+		if (kernels != nullptr)
+		{
+			return *kernels;
+		}
+	}
+
+	return ScalarKernels;
+}
+
+const PixelKernels& PixelKernels::GetBest()
+{
+	static const PixelKernels& best = SelectBestKernels();
+	return best;
+}
+
+const PixelKernels* PixelKernels::Get(PixelKernelSet set)
+{
+	switch (set)
+	{
+	case PixelKernelSet::Scalar:
+		return &ScalarKernels;
+
+#if HAS_X86_SIMD
+	case PixelKernelSet::SSE2:
+		return CPUFeatures::Get().hasSSE2 ? &SSE2Kernels : nullptr;
+
+	case PixelKernelSet::AVX2:
+		return CPUFeatures::Get().hasAVX2 ? &AVX2Kernels : nullptr;
+#endif
+
+	default:
+		return nullptr;
+	}
+}
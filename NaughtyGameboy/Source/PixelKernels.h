@@ -0,0 +1,50 @@
+#pragma once
+
+#include "PCH.h"
+
+enum class PixelKernelSet : byte
+{
+	Scalar,
+	SSE2,
+	AVX2,
+
+	Count
+};
+
+/**
+* The inner loops of the renderer, in one implementation per instruction set.
+* All the implementations produce exactly the same output. The scalar one is the reference.
+*/
+struct PixelKernels
+{
+	// The layout of the colors composeLine produces. BGP, OBP0 and OBP1 one after the other
+	static const byte BackgroundColors = 0;
+	static const byte Sprite0Colors = 4;
+	static const byte Sprite1Colors = 8;
+	static const int PaletteColorCount = 12;
+
+	const char* name;
+
+	/**
+	* Decode rowCount tile rows into 8 color indices (0-3) per row.
+	* Every row is 2 bytes of bitplanes, the low bits first. Bit 7 is the leftmost pixel.
+	*/
+	void(*decodeTileRows)(const byte* data, byte* indices, int rowCount);
+
+	/**
+	* Combine count pixels of the background line (background and window color indices), the sprite line
+	* (0 is transparent) and the flags of the sprites into indices of the 12 DMG palette colors:
+	* 0-3 are the BGP colors, 4-7 the OBP0 colors and 8-11 the OBP1 colors.
+	* A sprite pixel is drawn unless its priority flag is set and the background pixel isn't color 0
+	*/
+	void(*composeLine)(const byte* background, const byte* sprites, const byte* spriteFlags, byte* colors, int count);
+
+	/** Map count color indices through a palette of paletteSize ARGB8888 colors. Every index must be smaller than paletteSize */
+	void(*mapPalette)(const byte* indices, const uint* palette, int paletteSize, uint* pixels, int count);
+
+	/** The fastest kernels the CPU supports */
+	static const PixelKernels& GetBest();
+
+	/** The kernels of an instruction set. Null if the CPU or the build doesn't support it */
+	static const PixelKernels* Get(PixelKernelSet set);
+};
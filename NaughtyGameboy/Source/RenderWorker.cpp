@@ -0,0 +1,201 @@
+#include <cstring>
+#include "RenderWorker.h"
+#include "IORegisters.h"
+
+RenderWorker::RenderWorker(byte* framebuffer, int vramBankCount) :
+	m_isOAMDirty(true),
+	m_lineChangeCount(0),
+	m_tileCache(m_vram[0], m_dirtyTiles, vramBankCount, true),
+	m_spriteBuckets(m_oam, &m_isOAMDirty),
+	m_renderer(m_vram[0], m_oam, &m_tileCache, &m_spriteBuckets),
+	m_framebuffer(framebuffer),
+	m_lineSize(PixelFormats::GetLineSize(PixelFormat::ARGB8888)),
+	m_log(LogCapacity),
+	m_pushedCount(0),
+	m_processedCount(0)
+{
+	std::memset(m_vram, 0, sizeof(m_vram));
+	std::memset(m_oam, 0, sizeof(m_oam));
+	std::memset(m_ioRegisters, 0, sizeof(m_ioRegisters));
+	std::memset(m_dirtyTiles, 0xFF, sizeof(m_dirtyTiles));
+
+	m_thread = std::thread(&RenderWorker::Run, this);
+}
+
+RenderWorker::~RenderWorker()
+{
+	Push(Stop, 0, 0, 0);
+	m_thread.join();
+}
+
+void RenderWorker::Push(EntryType type, ushort address, byte value, ulonglong cycles)
+{
+	LogEntry entry;
+	entry.cycles = (uint)cycles;
+	entry.address = address;
+	entry.value = value;
+	entry.type = type;
+
+	while (!m_log.TryPush(entry))
+	{
+		std::this_thread::yield();
+	}
+
+	m_pushedCount++;
+}
+
+void RenderWorker::Flush()
+{
+	while (m_processedCount.load(std::memory_order_acquire) != m_pushedCount)
+	{
+		std::this_thread::yield();
+	}
+}
+
+void RenderWorker::SetPixelFormat(PixelFormat format)
+{
+	Flush();
+
+	// Published to the worker by the next push, like the state in Reset
+	m_renderer.SetPixelFormat(format);
+	m_lineSize = PixelFormats::GetLineSize(format);
+}
+
+void RenderWorker::SetFramebuffer(byte* framebuffer)
+{
+	Flush();
+
+	// Published to the worker by the next push, like the pixel format
+	m_framebuffer = framebuffer;
+}
+
+void RenderWorker::Reset(const MMU::Memory& memory)
+{
+	Flush();
+
+	// The worker is idle until the next push, which publishes these writes to it
+	std::memcpy(m_vram, memory.vram, sizeof(m_vram));
+	std::memcpy(m_oam, memory.oam, sizeof(m_oam));
+	std::memcpy(m_ioRegisters, memory.high, sizeof(m_ioRegisters));
+	std::memset(m_dirtyTiles, 0xFF, sizeof(m_dirtyTiles));
+	m_isOAMDirty = true;
+	m_lineChangeCount = 0;
+}
+
+void RenderWorker::Run()
+{
+	Backoff backoff;
+	while (true)
+	{
+		LogEntry entry;
+		if (!m_log.TryPop(&entry))
+		{
+			backoff.Wait();
+			continue;
+		}
+
+		backoff.Reset();
+
+		if (entry.type == Stop)
+		{
+			m_processedCount.fetch_add(1, std::memory_order_release);
+			return;
+		}
+
+		Replay(entry);
+		m_processedCount.fetch_add(1, std::memory_order_release);
+	}
+}
+
+void RenderWorker::Replay(const LogEntry& entry)
+{
+	switch (entry.type)
+	{
+	case RegisterWrite:
+		m_ioRegisters[entry.address & 0xFF] = entry.value;
+		break;
+
+	case VRAMWrite:
+	{
+		int bank = entry.address / MMU::VRAMBankSize;
+		int offset = entry.address % MMU::VRAMBankSize;
+		m_vram[bank][offset] = entry.value;
+
+		int tile = offset / MMU::TileSize;
+		if (tile < MMU::TilesPerBank)
+		{
+			tile += bank * MMU::TilesPerBank;
+			m_dirtyTiles[tile / 32] |= 1u << (tile % 32);
+		}
+		break;
+	}
+
+	case OAMWrite:
+		m_oam[entry.address] = entry.value;
+		m_isOAMDirty = true;
+		break;
+
+	case LineRegisterWrite:
+		if (m_lineChangeCount == 0)
+		{
+			m_lineStartRegisters = GetRegisters(0, 0);
+		}
+
+		if (m_lineChangeCount < MaxLineRegisterChanges)
+		{
+			RegisterChange& change = m_lineChanges[m_lineChangeCount++];
+			change.x = entry.address >> 8;
+			change.address = entry.address & 0xFF;
+			change.value = entry.value;
+		}
+
+		m_ioRegisters[entry.address & 0xFF] = entry.value;
+		break;
+
+	case BeginLine:
+		// A line that was cut short by turning the LCD off gets no RenderLine, so its log is dropped here
+		m_lineChangeCount = 0;
+		break;
+
+	case RenderLine:
+	{
+		byte ly = (byte)entry.address;
+		byte* line = m_framebuffer + ly * m_lineSize;
+		if (m_lineChangeCount == 0)
+		{
+			m_renderer.RenderLine(GetRegisters(ly, entry.value), line);
+		}
+		else
+		{
+			PPURegisters startRegisters = m_lineStartRegisters;
+			startRegisters.ly = ly;
+			startRegisters.windowLine = entry.value;
+			m_renderer.RenderLine(startRegisters, m_lineChanges, m_lineChangeCount, line);
+			m_lineChangeCount = 0;
+		}
+		break;
+	}
+	}
+}
+
+byte RenderWorker::GetRegister(ushort address) const
+{
+	return m_ioRegisters[address & 0xFF];
+}
+
+PPURegisters RenderWorker::GetRegisters(byte ly, byte windowLine) const
+{
+	PPURegisters registers;
+	registers.lcdc = GetRegister(IO::LCDC);
+	registers.scy = GetRegister(IO::SCY);
+	registers.scx = GetRegister(IO::SCX);
+	registers.ly = ly;
+	registers.wy = GetRegister(IO::WY);
+	registers.wx = GetRegister(IO::WX);
+	registers.bgp = GetRegister(IO::BGP);
+	registers.obp0 = GetRegister(IO::OBP0);
+	registers.obp1 = GetRegister(IO::OBP1);
+	registers.windowLine = windowLine;
+
+	return registers;
+}
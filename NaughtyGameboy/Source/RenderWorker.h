@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include "PCH.h"
+#include "LockFreeQueue.h"
+#include "MMU.h"
+#include "ScanlineRenderer.h"
+#include "SpriteBuckets.h"
+#include "TileCache.h"
+
+/**
+* Renders the scanlines on a thread of its own.
+* The emulation thread doesn't touch the renderer. It only appends the writes that affect the picture to a log,
+* in the order they happen, together with a marker for every line that has to be rendered. The worker replays the log
+* into its own copy of VRAM, OAM and the LCD registers, so every line sees exactly the state the single threaded
+* renderer would have seen, and the output is the same.
+*/
+class RenderWorker
+{
+public:
+	enum EntryType : byte
+	{
+		RegisterWrite, // address is the IO register
+		LineRegisterWrite, // A register write in the middle of a line. The low byte of address is the register, the high byte the pixel
+		VRAMWrite, // address is the offset in both VRAM banks (bank * 0x2000 + offset)
+		OAMWrite, // address is the offset in OAM
+		BeginLine, // The transfer of a line started. Clears the register writes logged for the line before, which may never have been drawn
+		RenderLine, // address is LY, value is the window line
+		Stop
+	};
+
+	struct LogEntry
+	{
+		uint cycles; // The lower bits of the cycle count when the write happened
+		ushort address;
+		byte value;
+		byte type;
+	};
+
+	static const size_t LogCapacity = 1 << 16;
+
+private:
+	// The worker's copy of the video memory. Written only by the worker, except while it's idle
+	byte m_vram[MMU::VRAMBankCount][MMU::VRAMBankSize];
+	byte m_oam[MMU::PageSize];
+	byte m_ioRegisters[MMU::PageSize];
+	uint m_dirtyTiles[MMU::VRAMBankCount * MMU::TilesPerBank / 32];
+	bool m_isOAMDirty;
+
+	// The register writes in the middle of the line that is drawn
+	PPURegisters m_lineStartRegisters;
+	RegisterChange m_lineChanges[MaxLineRegisterChanges];
+	int m_lineChangeCount;
+
+	TileCache m_tileCache;
+	SpriteBuckets m_spriteBuckets;
+	ScanlineRenderer m_renderer;
+	byte* m_framebuffer;
+	int m_lineSize; // Of the pixel format, in bytes
+
+	SPSCQueue<LogEntry> m_log;
+	ulonglong m_pushedCount; // Emulation thread only
+	std::atomic<ulonglong> m_processedCount;
+
+	std::thread m_thread;
+
+public:
+	/** The lines are rendered into framebuffer, which must stay alive as long as the worker */
+	RenderWorker(byte* framebuffer, int vramBankCount);
+	~RenderWorker();
+
+	RenderWorker(const RenderWorker&) = delete;
+	RenderWorker& operator=(const RenderWorker&) = delete;
+
+	/** Append an entry to the log. Waits if the worker is a whole log behind */
+	void Push(EntryType type, ushort address, byte value, ulonglong cycles);
+
+	/** Wait until the worker has replayed the whole log. The framebuffer is complete after that */
+	void Flush();
+
+	/** Render the following lines in format. Waits until the lines that were already pushed are done */
+	void SetPixelFormat(PixelFormat format);
+
+	/** Render the following lines into framebuffer. Waits until the lines that were already pushed are done */
+	void SetFramebuffer(byte* framebuffer);
+
+	/** Replace the worker's copy of the video memory, after the state of the machine was replaced */
+	void Reset(const MMU::Memory& memory);
+
+private:
+	void Run();
+	void Replay(const LogEntry& entry);
+
+	byte GetRegister(ushort address) const;
+	PPURegisters GetRegisters(byte ly, byte windowLine) const;
+};
@@ -0,0 +1,119 @@
+#include <cstring>
+#include "ScalerThread.h"
+#include "PPURegisters.h"
+
+// The queues only ever hold slot indices, so they never fill up
+static const size_t QueueCapacity = 4;
+
+ScalerThread::ScalerThread(ScaleFilter filter) :
+	m_filter(filter),
+	m_width(LCDWidth * Scalers::GetFactor(filter)),
+	m_height(LCDHeight * Scalers::GetFactor(filter)),
+	m_submitted(QueueCapacity),
+	m_scaled(QueueCapacity),
+	m_freeCount(SlotCount),
+	m_takenSlot(-1),
+	m_droppedCount(0)
+{
+	for (int i = 0; i < SlotCount; i++)
+	{
+		m_slots[i].source = std::make_unique<uint[]>(LCDWidth * LCDHeight);
+		m_slots[i].output = std::make_unique<uint[]>(m_width * m_height);
+		m_freeSlots[i] = i;
+	}
+
+	m_thread = std::thread(&ScalerThread::Run, this);
+}
+
+ScalerThread::~ScalerThread()
+{
+	while (!m_submitted.TryPush(-1))
+	{
+		std::this_thread::yield();
+	}
+
+	m_thread.join();
+}
+
+bool ScalerThread::Submit(const uint* framebuffer)
+{
+	if (m_freeCount == 0)
+	{
+		m_droppedCount++;
+		return false;
+	}
+
+	int slot = m_freeSlots[--m_freeCount];
+	std::memcpy(m_slots[slot].source.get(), framebuffer, LCDWidth * LCDHeight * sizeof(uint));
+	m_submitted.TryPush(slot);
+
+	return true;
+}
+
+const uint* ScalerThread::TakeScaledFrame()
+{
+	// Only the newest frame is shown. The older ones go straight back to the free slots
+	int newest = -1;
+	int slot;
+	while (m_scaled.TryPop(&slot))
+	{
+		if (newest >= 0)
+		{
+			m_freeSlots[m_freeCount++] = newest;
+		}
+
+		newest = slot;
+	}
+
+	if (newest < 0)
+	{
+		return nullptr;
+	}
+
+	if (m_takenSlot >= 0)
+	{
+		m_freeSlots[m_freeCount++] = m_takenSlot;
+	}
+
+	m_takenSlot = newest;
+	return m_slots[newest].output.get();
+}
+
+int ScalerThread::GetWidth() const
+{
+	return m_width;
+}
+
+int ScalerThread::GetHeight() const
+{
+	return m_height;
+}
+
+ulonglong ScalerThread::GetDroppedCount() const
+{
+	return m_droppedCount;
+}
+
+void ScalerThread::Run()
+{
+	Backoff backoff;
+	while (true)
+	{
+		int slot;
+		if (!m_submitted.TryPop(&slot))
+		{
+			backoff.Wait();
+			continue;
+		}
+
+		backoff.Reset();
+
+		if (slot < 0)
+		{
+			return;
+		}
+
+		Scalers::Scale(m_filter, m_slots[slot].source.get(), m_slots[slot].output.get());
+		m_scaled.TryPush(slot);
+	}
+}
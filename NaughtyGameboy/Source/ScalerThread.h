@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include "PCH.h"
+#include "LockFreeQueue.h"
+#include "Scalers.h"
+
+/**
+* Scales the presented frames on a thread of its own, so the filter doesn't add to the frame time of the emulation.
+* A frame goes through one of SlotCount slots: it's copied into a free slot, scaled by the worker and then taken for
+* the upload. The emulation never waits for the worker. When every slot is busy the frame is dropped,
+* and the screen keeps the last scaled frame until the worker catches up.
+*/
+class ScalerThread
+{
+public:
+	static const int SlotCount = 3; // One being filled, one being scaled and one being uploaded
+
+private:
+	struct Slot
+	{
+		std::unique_ptr<uint[]> source;
+		std::unique_ptr<uint[]> output;
+	};
+
+	ScaleFilter m_filter;
+	int m_width;
+	int m_height;
+	Slot m_slots[SlotCount];
+
+	// The slots travel between the threads as their indices. The free slots are owned by the calling thread
+	SPSCQueue<int> m_submitted; // To be scaled. -1 stops the worker
+	SPSCQueue<int> m_scaled; // Scaled, not taken yet
+	int m_freeSlots[SlotCount];
+	int m_freeCount;
+	int m_takenSlot; // The slot returned by the last TakeScaledFrame. -1 if there is none
+
+	ulonglong m_droppedCount;
+
+	std::thread m_thread;
+
+public:
+	ScalerThread(ScaleFilter filter);
+	~ScalerThread();
+
+	ScalerThread(const ScalerThread&) = delete;
+	ScalerThread& operator=(const ScalerThread&) = delete;
+
+	/** Queue a LCDWidth x LCDHeight ARGB8888 frame for scaling. Returns false if every slot is busy and the frame was dropped */
+	bool Submit(const uint* framebuffer);
+
+	/**
+	* The newest scaled frame that wasn't taken yet, GetWidth() x GetHeight() pixels. Null if there is none.
+	* Stays valid until the next call.
+	*/
+	const uint* TakeScaledFrame();
+
+	int GetWidth() const;
+	int GetHeight() const;
+
+	/** The frames that were dropped because the worker was busy */
+	ulonglong GetDroppedCount() const;
+
+private:
+	void Run();
+};
@@ -0,0 +1,276 @@
+#include <cstring>
+#include "Scalers.h"
+#include "CPUFeatures.h"
+#include "PPURegisters.h"
+
+#if HAS_X86_SIMD
+#include <emmintrin.h>
+#endif
+
+static const char* const FilterNames[] = { "none", "nearest2x", "nearest3x", "nearest4x", "scale2x", "smooth2x" };
+
+// 3/4 of the edge color and 1/4 of the pixel
+static uint BlendTowards(uint pixel, uint edge)
+{
+	return Scalers::Average(edge, Scalers::Average(edge, pixel));
+}
+
+// The rows of the source around row y, with the edges of the frame repeated
+struct SourceRows
+{
+	const uint* up;
+	const uint* middle;
+	const uint* down;
+};
+
+static SourceRows GetSourceRows(const uint* source, int y)
+{
+	SourceRows rows;
+	rows.up = source + ((y > 0) ? y - 1 : y) * LCDWidth;
+	rows.middle = source + y * LCDWidth;
+	rows.down = source + ((y < LCDHeight - 1) ? y + 1 : y) * LCDWidth;
+
+	return rows;
+}
+
+// Scale2x and Smooth2x of the pixels from startX to endX of a row. Writes 2 pixels into each of the 2 output rows
+static void ScaleEdgesScalar(const SourceRows& rows, uint* output0, uint* output1, int startX, int endX, bool isSmooth)
+{
+	for (int x = startX; x < endX; x++)
+	{
+		uint p = rows.middle[x];
+		uint a = rows.up[x];
+		uint d = rows.down[x];
+		uint c = rows.middle[(x > 0) ? x - 1 : x];
+		uint b = rows.middle[(x < LCDWidth - 1) ? x + 1 : x];
+
+		// Each corner takes the color of the two neighbours next to it, if they are the same and form an edge
+		bool isEdge0 = (c == a && c != d && a != b);
+		bool isEdge1 = (a == b && a != c && b != d);
+		bool isEdge2 = (d == c && d != b && c != a);
+		bool isEdge3 = (b == d && b != a && d != c);
+
+		if (isSmooth)
+		{
+			output0[x * 2] = isEdge0 ? BlendTowards(p, a) : p;
+			output0[x * 2 + 1] = isEdge1 ? BlendTowards(p, b) : p;
+			output1[x * 2] = isEdge2 ? BlendTowards(p, c) : p;
+			output1[x * 2 + 1] = isEdge3 ? BlendTowards(p, d) : p;
+		}
+		else
+		{
+			output0[x * 2] = isEdge0 ? a : p;
+			output0[x * 2 + 1] = isEdge1 ? b : p;
+			output1[x * 2] = isEdge2 ? c : p;
+			output1[x * 2 + 1] = isEdge3 ? d : p;
+		}
+	}
+}
+
+static void ScaleNearestRowScalar(const uint* row, uint* output, int factor)
+{
+	for (int x = 0; x < LCDWidth; x++)
+	{
+		for (int i = 0; i < factor; i++)
+		{
+			output[x * factor + i] = row[x];
+		}
+	}
+}
+
+#if HAS_X86_SIMD
+static void ScaleNearestRowSSE2(const uint* row, uint* output, int factor)
+{
+	__m128i* out = reinterpret_cast<__m128i*>(output);
+	for (int x = 0; x < LCDWidth; x += 4)
+	{
+		__m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x));
+		switch (factor)
+		{
+		case 2:
+			_mm_storeu_si128(out++, _mm_unpacklo_epi32(pixels, pixels));
+			_mm_storeu_si128(out++, _mm_unpackhi_epi32(pixels, pixels));
+			break;
+
+		case 3:
+			// a a a b, b b c c, c d d d
+			_mm_storeu_si128(out++, _mm_shuffle_epi32(pixels, _MM_SHUFFLE(1, 0, 0, 0)));
+			_mm_storeu_si128(out++, _mm_shuffle_epi32(pixels, _MM_SHUFFLE(2, 2, 1, 1)));
+			_mm_storeu_si128(out++, _mm_shuffle_epi32(pixels, _MM_SHUFFLE(3, 3, 3, 2)));
+			break;
+
+		default:
+			_mm_storeu_si128(out++, _mm_shuffle_epi32(pixels, _MM_SHUFFLE(0, 0, 0, 0)));
+			_mm_storeu_si128(out++, _mm_shuffle_epi32(pixels, _MM_SHUFFLE(1, 1, 1, 1)));
+			_mm_storeu_si128(out++, _mm_shuffle_epi32(pixels, _MM_SHUFFLE(2, 2, 2, 2)));
+			_mm_storeu_si128(out++, _mm_shuffle_epi32(pixels, _MM_SHUFFLE(3, 3, 3, 3)));
+			break;
+		}
+	}
+}
+
+static __m128i Select(__m128i mask, __m128i ifSet, __m128i ifClear)
+{
+	return _mm_or_si128(_mm_and_si128(mask, ifSet), _mm_andnot_si128(mask, ifClear));
+}
+
+// 4 pixels at a time. The loads of the left and right neighbours need a pixel on each side, so the first and last pixels are scalar
+static void ScaleEdgesSSE2(const SourceRows& rows, uint* output0, uint* output1, bool isSmooth)
+{
+	int x = 1;
+	for (; x + 4 < LCDWidth; x += 4)
+	{
+		__m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows.middle + x));
+		__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows.up + x));
+		__m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows.down + x));
+		__m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows.middle + x - 1));
+		__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows.middle + x + 1));
+
+		__m128i isCA = _mm_cmpeq_epi32(c, a);
+		__m128i isCD = _mm_cmpeq_epi32(c, d);
+		__m128i isAB = _mm_cmpeq_epi32(a, b);
+		__m128i isBD = _mm_cmpeq_epi32(b, d);
+
+		__m128i isEdge0 = _mm_andnot_si128(_mm_or_si128(isCD, isAB), isCA);
+		__m128i isEdge1 = _mm_andnot_si128(_mm_or_si128(isCA, isBD), isAB);
+		__m128i isEdge2 = _mm_andnot_si128(_mm_or_si128(isBD, isCA), isCD);
+		__m128i isEdge3 = _mm_andnot_si128(_mm_or_si128(isAB, isCD), isBD);
+
+		__m128i edge0 = a;
+		__m128i edge1 = b;
+		__m128i edge2 = c;
+		__m128i edge3 = d;
+		if (isSmooth)
+		{
+			edge0 = _mm_avg_epu8(a, _mm_avg_epu8(a, p));
+			edge1 = _mm_avg_epu8(b, _mm_avg_epu8(b, p));
+			edge2 = _mm_avg_epu8(c, _mm_avg_epu8(c, p));
+			edge3 = _mm_avg_epu8(d, _mm_avg_epu8(d, p));
+		}
+
+		__m128i e0 = Select(isEdge0, edge0, p);
+		__m128i e1 = Select(isEdge1, edge1, p);
+		__m128i e2 = Select(isEdge2, edge2, p);
+		__m128i e3 = Select(isEdge3, edge3, p);
+
+		// The corners of a pixel are next to each other in the output rows
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(output0 + x * 2), _mm_unpacklo_epi32(e0, e1));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(output0 + x * 2 + 4), _mm_unpackhi_epi32(e0, e1));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(output1 + x * 2), _mm_unpacklo_epi32(e2, e3));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(output1 + x * 2 + 4), _mm_unpackhi_epi32(e2, e3));
+	}
+
+	ScaleEdgesScalar(rows, output0, output1, 0, 1, isSmooth);
+	ScaleEdgesScalar(rows, output0, output1, x, LCDWidth, isSmooth);
+}
+#endif
+
+static void ScaleFrame(ScaleFilter filter, const uint* source, uint* destination, bool isSIMD)
+{
+	int factor = Scalers::GetFactor(filter);
+	int outputWidth = LCDWidth * factor;
+
+	for (int y = 0; y < LCDHeight; y++)
+	{
+		uint* output = destination + y * factor * outputWidth;
+		switch (filter)
+		{
+		case ScaleFilter::Scale2x:
+		case ScaleFilter::Smooth2x:
+		{
+			SourceRows rows = GetSourceRows(source, y);
+			bool isSmooth = (filter == ScaleFilter::Smooth2x);
+#if HAS_X86_SIMD
+			if (isSIMD)
+			{
+				ScaleEdgesSSE2(rows, output, output + outputWidth, isSmooth);
+				break;
+			}
+#endif
+			ScaleEdgesScalar(rows, output, output + outputWidth, 0, LCDWidth, isSmooth);
+			break;
+		}
+
+		default:
+		{
+			// The first output row is scaled, the others are copies of it
+#if HAS_X86_SIMD
+			if (isSIMD)
+			{
+				ScaleNearestRowSSE2(source + y * LCDWidth, output, factor);
+			}
+			else
+#endif
+			{
+				ScaleNearestRowScalar(source + y * LCDWidth, output, factor);
+			}
+
+			for (int i = 1; i < factor; i++)
+			{
+				std::memcpy(output + i * outputWidth, output, outputWidth * sizeof(uint));
+			}
+			break;
+		}
+		}
+	}
+}
+
+int Scalers::GetFactor(ScaleFilter filter)
+{
+	switch (filter)
+	{
+	case ScaleFilter::Nearest3x:
+		return 3;
+
+	case ScaleFilter::Nearest4x:
+		return 4;
+
+	case ScaleFilter::Nearest2x:
+	case ScaleFilter::Scale2x:
+	case ScaleFilter::Smooth2x:
+		return 2;
+
+	default:
+		return 1;
+	}
+}
+
+const char* Scalers::GetName(ScaleFilter filter)
+{
+	return ((int)filter < ARRAY_SIZE(FilterNames)) ? FilterNames[(int)filter] : FilterNames[0];
+}
+
+ScaleFilter Scalers::FromName(const char* name)
+{
+	for (int i = 0; i < ARRAY_SIZE(FilterNames); i++)
+	{
+		if (std::strcmp(name, FilterNames[i]) == 0)
+		{
+			return (ScaleFilter)i;
+		}
+	}
+
+	return ScaleFilter::None;
+}
+
+void Scalers::Scale(ScaleFilter filter, const uint* source, uint* destination)
+{
+	if (filter == ScaleFilter::None)
+	{
+		std::memcpy(destination, source, LCDWidth * LCDHeight * sizeof(uint));
+		return;
+	}
+
+	ScaleFrame(filter, source, destination, CPUFeatures::Get().hasSSE2);
+}
+
+void Scalers::ScaleReference(ScaleFilter filter, const uint* source, uint* destination)
+{
+	if (filter == ScaleFilter::None)
+	{
+		std::memcpy(destination, source, LCDWidth * LCDHeight * sizeof(uint));
+		return;
+	}
+
+	ScaleFrame(filter, source, destination, false);
+}
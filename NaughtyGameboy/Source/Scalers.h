@@ -0,0 +1,43 @@
+#pragma once
+
+#include "PCH.h"
+
+enum class ScaleFilter : byte
+{
+	None,
+	Nearest2x,
+	Nearest3x,
+	Nearest4x,
+	Scale2x, // EPX. Copies a neighbour into the corners where two edges meet, so diagonals stay sharp without steps
+	Smooth2x, // A simplified xBR. Finds the edges like Scale2x, but blends the corners towards the edge color instead of copying it
+
+	Count
+};
+
+/**
+* Scale a LCDWidth x LCDHeight ARGB8888 frame on the CPU, for the presentation path.
+* The SIMD row kernels and the scalar reference produce exactly the same output.
+*/
+namespace Scalers
+{
+	/** How many times larger the output is in each direction. 1 for None */
+	int GetFactor(ScaleFilter filter);
+
+	/** The name used on the command line */
+	const char* GetName(ScaleFilter filter);
+
+	/** The filter with the name. None if there is no such filter */
+	ScaleFilter FromName(const char* name);
+
+	/** Scale source into destination, which is GetFactor(filter) * LCDWidth pixels wide. Uses SIMD when the CPU has it */
+	void Scale(ScaleFilter filter, const uint* source, uint* destination);
+
+	/** The scalar implementation the SIMD one is verified against */
+	void ScaleReference(ScaleFilter filter, const uint* source, uint* destination);
+
+	/** The rounding average of every byte of two ARGB8888 pixels, like _mm_avg_epu8. The SIMD paths match it exactly */
+	inline uint Average(uint a, uint b)
+	{
+		return (a | b) - (((a ^ b) >> 1) & 0x7F7F7F7F);
+	}
+}
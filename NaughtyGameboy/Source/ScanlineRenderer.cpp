@@ -0,0 +1,219 @@
+#include <cstring>
+#include "ScanlineRenderer.h"
+#include "BitUtil.h"
+#include "IORegisters.h"
+#include "PixelKernels.h"
+#include "SpriteBuckets.h"
+#include "TileCache.h"
+
+// Offsets in VRAM
+static const ushort TileMap0 = 0x1800; // 0x9800
+static const ushort TileMap1 = 0x1C00; // 0x9C00
+static const int TileMapWidth = 32;
+
+ScanlineRenderer::ScanlineRenderer(const byte* vram, const byte* oam, TileCache* tileCache, SpriteBuckets* spriteBuckets) :
+	m_vram(vram),
+	m_oam(oam),
+	m_tileCache(tileCache),
+	m_spriteBuckets(spriteBuckets),
+	m_kernels(&PixelKernels::GetBest())
+{
+	SetPixelFormat(PixelFormat::ARGB8888);
+}
+
+void ScanlineRenderer::SetPixelFormat(PixelFormat format)
+{
+	m_format = format;
+	for (int i = 0; i < 4; i++)
+	{
+		m_shadeValues[i] = PixelFormats::GetShadeValue(format, (byte)i);
+	}
+}
+
+void ScanlineRenderer::RenderLine(const PPURegisters& registers, byte* line)
+{
+	if (IsBlankLine(registers))
+	{
+		// Nothing to fetch or compose. On the DMG the disabled background is white, not BGP color 0
+		PixelFormats::Fill(m_format, line, LCDWidth, 0);
+		return;
+	}
+
+	RenderSegment(registers, line, 0, LCDWidth);
+}
+
+void ScanlineRenderer::RenderLine(const PPURegisters& registers, const RegisterChange* changes, int changeCount, byte* line)
+{
+	// Every segment is rendered like a whole line, but only its own pixels are composed.
+	// Lines with changes are rare enough that the repeated fetches don't matter
+	PPURegisters segmentRegisters = registers;
+	int fineScroll = registers.scx % 8;
+	int startX = 0;
+	for (int i = 0; i < changeCount; i++)
+	{
+		const RegisterChange& change = changes[i];
+
+		// The palettes are read when a pixel is output, but the scroll only when a tile is fetched.
+		// The fetch of a tile starts about a tile ahead, so the scroll changes from the first tile fetched after the write
+		int changeX = change.x;
+		if ((0xFF00 | change.address) == IO::SCX || (0xFF00 | change.address) == IO::SCY)
+		{
+			changeX = (change.x + FetchLeadPixels + fineScroll + 7) / 8 * 8 - fineScroll;
+		}
+
+		int endX = (changeX < LCDWidth) ? changeX : LCDWidth;
+		if (endX > startX)
+		{
+			RenderSegment(segmentRegisters, line, startX, endX);
+			startX = endX;
+		}
+
+		segmentRegisters.Apply(change.address, change.value);
+
+		// The fine scroll is latched at the start of the line. Only the tiles fetched afterwards use the new SCX
+		segmentRegisters.scx = (segmentRegisters.scx & ~7) | fineScroll;
+	}
+
+	if (startX < LCDWidth)
+	{
+		RenderSegment(segmentRegisters, line, startX, LCDWidth);
+	}
+}
+
+void ScanlineRenderer::RenderSegment(const PPURegisters& registers, byte* line, int startX, int endX)
+{
+	if (IS_BIT_SET(registers.lcdc, LCDCBit::BackgroundEnable))
+	{
+		RenderBackground(registers);
+
+		if (IsWindowVisible(registers))
+		{
+			RenderWindow(registers);
+		}
+	}
+	else
+	{
+		std::memset(m_backgroundLine + LinePadding, 0, LCDWidth);
+	}
+
+	// The flags are cleared too, since the compose kernels read all of them and only then mask out the transparent pixels
+	std::memset(m_spriteLine, 0, sizeof(m_spriteLine));
+	std::memset(m_spriteFlags, 0, sizeof(m_spriteFlags));
+	if (IS_BIT_SET(registers.lcdc, LCDCBit::SpriteEnable))
+	{
+		RenderSprites(registers);
+	}
+
+	ComposeLine(registers, line, startX, endX);
+}
+
+bool ScanlineRenderer::IsBlankLine(const PPURegisters& registers)
+{
+	// On the DMG the background enable bit turns off the window too
+	return !IS_BIT_SET(registers.lcdc, LCDCBit::BackgroundEnable) && !IS_BIT_SET(registers.lcdc, LCDCBit::SpriteEnable);
+}
+
+bool ScanlineRenderer::IsWindowVisible(const PPURegisters& registers)
+{
+	return IS_BIT_SET(registers.lcdc, LCDCBit::BackgroundEnable) &&
+		IS_BIT_SET(registers.lcdc, LCDCBit::WindowEnable) &&
+		registers.ly >= registers.wy &&
+		registers.wx < LCDWidth + 7;
+}
+
+void ScanlineRenderer::RenderBackground(const PPURegisters& registers)
+{
+	ushort tileMap = IS_BIT_SET(registers.lcdc, LCDCBit::BackgroundTileMap) ? TileMap1 : TileMap0;
+	byte y = registers.scy + registers.ly;
+	const byte* tileRowMap = m_vram + tileMap + (y / 8) * TileMapWidth;
+
+	// The first tile starts left of the screen by the fine scroll
+	CopyTileRows(registers.lcdc, tileRowMap, registers.scx / 8, -(registers.scx % 8), y % 8);
+}
+
+void ScanlineRenderer::RenderWindow(const PPURegisters& registers)
+{
+	ushort tileMap = IS_BIT_SET(registers.lcdc, LCDCBit::WindowTileMap) ? TileMap1 : TileMap0;
+	const byte* tileRowMap = m_vram + tileMap + (registers.windowLine / 8) * TileMapWidth;
+
+	// WX is the window position + 7. It never starts more than 7 pixels left of the screen
+	CopyTileRows(registers.lcdc, tileRowMap, 0, registers.wx - 7, registers.windowLine % 8);
+}
+
+void ScanlineRenderer::CopyTileRows(byte lcdc, const byte* tileRowMap, byte mapX, int screenX, int row)
+{
+	for (; screenX < LCDWidth; screenX += TileCache::TileWidth)
+	{
+		int tile = TileCache::GetBackgroundTile(lcdc, tileRowMap[mapX % TileMapWidth]);
+		const byte* tileRow = m_tileCache->GetTileRow(0, tile, row, false);
+		std::memcpy(m_backgroundLine + LinePadding + screenX, tileRow, TileCache::TileWidth);
+
+		mapX++;
+	}
+}
+
+void ScanlineRenderer::RenderSprites(const PPURegisters& registers)
+{
+	int height = IS_BIT_SET(registers.lcdc, LCDCBit::SpriteSize) ? 16 : 8;
+
+	// The sprites of the line come from the buckets, already limited to 10 and sorted by priority.
+	// The highest priority is drawn first into the empty pixels
+	const SpriteAttributes* sprites = reinterpret_cast<const SpriteAttributes*>(m_oam);
+	const SpriteBuckets::Bucket& bucket = m_spriteBuckets->GetBucket(registers.ly, height);
+	for (int i = 0; i < bucket.count; i++)
+	{
+		const SpriteAttributes& sprite = sprites[bucket.prioritySprites[i]];
+
+		byte row = (byte)(registers.ly - (sprite.y - 16));
+		if (IS_BIT_SET(sprite.flags, SpriteFlag::FlipY))
+		{
+			row = (byte)(height - 1 - row);
+		}
+
+		// In 8x16 mode the lowest bit of the tile index is ignored, and the bottom half is the next tile
+		int tile = (height == 16) ? ((sprite.tile & 0xFE) + row / 8) : sprite.tile;
+		const byte* tileRow = m_tileCache->GetTileRow(0, tile, row % 8, IS_BIT_SET(sprite.flags, SpriteFlag::FlipX));
+
+		for (int tileX = 0; tileX < TileCache::TileWidth; tileX++)
+		{
+			int screenX = sprite.x - 8 + tileX;
+			if (screenX < 0 || screenX >= LCDWidth || m_spriteLine[screenX] != 0)
+			{
+				continue;
+			}
+
+			byte color = tileRow[tileX];
+			if (color != 0)
+			{
+				m_spriteLine[screenX] = color;
+				m_spriteFlags[screenX] = sprite.flags;
+			}
+		}
+	}
+}
+
+void ScanlineRenderer::ComposeLine(const PPURegisters& registers, byte* line, int startX, int endX)
+{
+	// BGP, OBP0 and OBP1 resolved to shade values in the pixel format, one after the other.
+	// On the DMG a disabled background is white, whatever BGP maps color 0 to
+	byte bgp = IS_BIT_SET(registers.lcdc, LCDCBit::BackgroundEnable) ? registers.bgp : 0x00;
+	uint palette[PixelKernels::PaletteColorCount];
+	for (int i = 0; i < 4; i++)
+	{
+		palette[PixelKernels::BackgroundColors + i] = m_shadeValues[(bgp >> (i * 2)) & 0x03];
+		palette[PixelKernels::Sprite0Colors + i] = m_shadeValues[(registers.obp0 >> (i * 2)) & 0x03];
+		palette[PixelKernels::Sprite1Colors + i] = m_shadeValues[(registers.obp1 >> (i * 2)) & 0x03];
+	}
+
+	m_kernels->composeLine(m_backgroundLine + LinePadding + startX, m_spriteLine + startX, m_spriteFlags + startX, m_colorLine + startX, endX - startX);
+
+	// The pixels go straight into the line in its format. Only the 32 bit format has a SIMD kernel
+	if (m_format == PixelFormat::ARGB8888)
+	{
+		m_kernels->mapPalette(m_colorLine + startX, palette, PixelKernels::PaletteColorCount, reinterpret_cast<uint*>(line) + startX, endX - startX);
+	}
+	else
+	{
+		PixelFormats::MapPalette(m_format, m_colorLine + startX, palette, line, startX, endX - startX);
+	}
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "PCH.h"
+#include "PixelFormat.h"
+#include "PPURegisters.h"
+
+class SpriteBuckets;
+class TileCache;
+struct PixelKernels;
+
+/**
+* Renders a whole scanline at once from VRAM and OAM.
+* It doesn't keep any state between lines, so it can render from any copy of the video memory.
+*/
+class ScanlineRenderer
+{
+private:
+	// The background line has a tile of padding on both sides, so whole tile rows can be copied into it
+	static const int LinePadding = 8;
+
+	// How far ahead of the output the fetcher reads the tile index, in pixels
+	static const int FetchLeadPixels = 7;
+
+private:
+	const byte* m_vram;
+	const byte* m_oam;
+	TileCache* m_tileCache;
+	SpriteBuckets* m_spriteBuckets;
+	const PixelKernels* m_kernels;
+	PixelFormat m_format;
+
+	// The values of the 4 shades in the pixel format
+	uint m_shadeValues[4];
+
+	// The color indices of the line, before they go through the palettes
+	byte m_backgroundLine[LinePadding + LCDWidth + LinePadding];
+	byte m_spriteLine[LCDWidth]; // 0 is transparent
+	byte m_spriteFlags[LCDWidth];
+	byte m_colorLine[LCDWidth]; // Indices into the palette colors
+
+public:
+	/** The tiles are fetched from tileCache and the sprites of a line from spriteBuckets, which must cache the same vram and oam */
+	ScanlineRenderer(const byte* vram, const byte* oam, TileCache* tileCache, SpriteBuckets* spriteBuckets);
+
+	/** The format of the lines that are rendered. ARGB8888 by default */
+	void SetPixelFormat(PixelFormat format);
+
+	/** Render line registers.ly into line, which is LCDWidth pixels in the pixel format */
+	void RenderLine(const PPURegisters& registers, byte* line);
+
+	/**
+	* Render a line whose registers changed while it was drawn. registers are the values at the start of the line,
+	* and the line is split into segments at the changes, which must be in the order they were written
+	*/
+	void RenderLine(const PPURegisters& registers, const RegisterChange* changes, int changeCount, byte* line);
+
+	/** Whether the background, the window and the sprites are all off, so every pixel of the line is white (shade 0) whatever BGP is */
+	static bool IsBlankLine(const PPURegisters& registers);
+
+	/** Whether the window covers part of the line */
+	static bool IsWindowVisible(const PPURegisters& registers);
+
+private:
+	void RenderBackground(const PPURegisters& registers);
+	void RenderWindow(const PPURegisters& registers);
+	void RenderSprites(const PPURegisters& registers);
+	/** Render only the pixels from startX to endX */
+	void RenderSegment(const PPURegisters& registers, byte* line, int startX, int endX);
+
+	void ComposeLine(const PPURegisters& registers, byte* line, int startX, int endX);
+
+	/** Copy the tile rows of a tile map row into the background line, starting at screenX */
+	void CopyTileRows(byte lcdc, const byte* tileRowMap, byte mapX, int screenX, int row);
+};
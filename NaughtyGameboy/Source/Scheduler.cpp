@@ -0,0 +1,117 @@
+#include "Scheduler.h"
+#include "StateArena.h"
+
+static const ulonglong NoEventCycles = ~0ULL;
+
+Scheduler::Scheduler(StateArena* arena) :
+	m_state(arena->Allocate<State>())
+{
+	m_state->cycles = 0;
+	m_state->nextEventCycles = NoEventCycles;
+
+	for (int i = 0; i < (int)SchedulerEvent::Count; i++)
+	{
+		m_state->dueCycles[i] = NoEventCycles;
+		m_state->isScheduled[i] = false;
+
+		m_callbacks[i].callback = nullptr;
+		m_callbacks[i].context = nullptr;
+	}
+}
+
+void Scheduler::Register(SchedulerEvent event, SchedulerCallback callback, void* context)
+{
+	Callback& c = m_callbacks[(int)event];
+	c.callback = callback;
+	c.context = context;
+}
+
+void Scheduler::Schedule(SchedulerEvent event, ulong cycles)
+{
+	int index = (int)event;
+	m_state->dueCycles[index] = m_state->cycles + cycles;
+	m_state->isScheduled[index] = true;
+
+	if (m_state->dueCycles[index] < m_state->nextEventCycles)
+	{
+		m_state->nextEventCycles = m_state->dueCycles[index];
+	}
+	else
+	{
+		// The event may have been the earliest one before it was rescheduled
+		UpdateNextEventCycles();
+	}
+}
+
+void Scheduler::Cancel(SchedulerEvent event)
+{
+	int index = (int)event;
+	if (m_state->isScheduled[index])
+	{
+		m_state->isScheduled[index] = false;
+		m_state->dueCycles[index] = NoEventCycles;
+		UpdateNextEventCycles();
+	}
+}
+
+bool Scheduler::IsScheduled(SchedulerEvent event) const
+{
+	return m_state->isScheduled[(int)event];
+}
+
+ulong Scheduler::GetCyclesUntil(SchedulerEvent event) const
+{
+	int index = (int)event;
+	if (!m_state->isScheduled[index] || m_state->dueCycles[index] <= m_state->cycles)
+	{
+		return 0;
+	}
+
+	return (ulong)(m_state->dueCycles[index] - m_state->cycles);
+}
+
+ulonglong Scheduler::GetCycles() const
+{
+	return m_state->cycles;
+}
+
+void Scheduler::AddCycles(ulong cycles)
+{
+	m_state->cycles += cycles;
+
+	// A callback can schedule new events (even ones that are already due), so look for the earliest event every time
+	while (m_state->nextEventCycles <= m_state->cycles)
+	{
+		int earliest = -1;
+		for (int i = 0; i < (int)SchedulerEvent::Count; i++)
+		{
+			if (m_state->isScheduled[i] && (earliest < 0 || m_state->dueCycles[i] < m_state->dueCycles[earliest]))
+			{
+				earliest = i;
+			}
+		}
+
+		ulong lateCycles = (ulong)(m_state->cycles - m_state->dueCycles[earliest]);
+		m_state->isScheduled[earliest] = false;
+		m_state->dueCycles[earliest] = NoEventCycles;
+		UpdateNextEventCycles();
+
+		const Callback& c = m_callbacks[earliest];
+		if (c.callback != nullptr)
+		{
+			c.callback(c.context, lateCycles);
+		}
+	}
+}
+
+void Scheduler::UpdateNextEventCycles()
+{
+	m_state->nextEventCycles = NoEventCycles;
+	for (int i = 0; i < (int)SchedulerEvent::Count; i++)
+	{
+		if (m_state->isScheduled[i] && m_state->dueCycles[i] < m_state->nextEventCycles)
+		{
+			m_state->nextEventCycles = m_state->dueCycles[i];
+		}
+	}
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "PCH.h"
+
+class StateArena;
+
+enum class SchedulerEvent : byte
+{
+	OAMDMAEnd, // The OAM DMA transfer finished and the bus is released
+	PPUModeEnd, // The PPU finished its current mode
+	HDMABlock, // A 16 byte block of a CGB general purpose or HBlank DMA is done
+
+	Count
+};
+
+/** Called when a scheduled event is due. lateCycles is how many cycles past its due time the event runs */
+typedef void(*SchedulerCallback)(void* context, ulong lateCycles);
+
+/**
+* Keeps the timestamps of the upcoming hardware events, so the subsystems don't have to be stepped every instruction.
+* Every event type can be scheduled at most once at a time.
+*/
+class Scheduler
+{
+public:
+	/** The time and the due events. Lives in the state arena */
+	struct State
+	{
+		ulonglong cycles; // Total cycles since power on
+		ulonglong nextEventCycles; // Due time of the earliest scheduled event
+		ulonglong dueCycles[(int)SchedulerEvent::Count];
+		bool isScheduled[(int)SchedulerEvent::Count];
+	};
+
+private:
+	struct Callback
+	{
+		SchedulerCallback callback;
+		void* context;
+	};
+
+private:
+	State* m_state;
+	Callback m_callbacks[(int)SchedulerEvent::Count];
+
+public:
+	Scheduler(StateArena* arena);
+
+	/** Set the callback of an event type */
+	void Register(SchedulerEvent event, SchedulerCallback callback, void* context);
+
+	/** Schedule an event cycles from now. Reschedules the event if it's already scheduled */
+	void Schedule(SchedulerEvent event, ulong cycles);
+
+	void Cancel(SchedulerEvent event);
+
+	bool IsScheduled(SchedulerEvent event) const;
+
+	/** Cycles left until the event is due */
+	ulong GetCyclesUntil(SchedulerEvent event) const;
+
+	ulonglong GetCycles() const;
+
+	/** Advance the time and run all the events that became due */
+	void AddCycles(ulong cycles);
+
+private:
+	void UpdateNextEventCycles();
+};
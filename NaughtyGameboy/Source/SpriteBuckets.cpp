@@ -0,0 +1,75 @@
+#include <cstring>
+#include "SpriteBuckets.h"
+
+SpriteBuckets::SpriteBuckets(const byte* oam, bool* isOAMDirty) :
+	m_oam(oam),
+	m_isOAMDirty(isOAMDirty),
+	m_spriteHeight(0),
+	m_rebuildCount(0)
+{
+	std::memset(m_buckets, 0, sizeof(m_buckets));
+}
+
+const SpriteBuckets::Bucket& SpriteBuckets::GetBucket(byte ly, int spriteHeight)
+{
+	if (*m_isOAMDirty || spriteHeight != m_spriteHeight)
+	{
+		Rebuild(spriteHeight);
+	}
+
+	return m_buckets[ly];
+}
+
+ulonglong SpriteBuckets::GetRebuildCount() const
+{
+	return m_rebuildCount;
+}
+
+void SpriteBuckets::Rebuild(int spriteHeight)
+{
+	*m_isOAMDirty = false;
+	m_spriteHeight = spriteHeight;
+	m_rebuildCount++;
+
+	for (int i = 0; i < LCDHeight; i++)
+	{
+		m_buckets[i].count = 0;
+	}
+
+	// Going through OAM in order fills every bucket with the first 10 sprites on its line, like the OAM scan
+	const SpriteAttributes* sprites = reinterpret_cast<const SpriteAttributes*>(m_oam);
+	for (int i = 0; i < SpriteCount; i++)
+	{
+		// Y is the position + 16, so a sprite can start above the screen
+		int top = sprites[i].y - 16;
+		int startLine = (top > 0) ? top : 0;
+		int endLine = (top + spriteHeight < LCDHeight) ? top + spriteHeight : LCDHeight;
+		for (int line = startLine; line < endLine; line++)
+		{
+			Bucket& bucket = m_buckets[line];
+			if (bucket.count < MaxSpritesPerLine)
+			{
+				bucket.sprites[bucket.count++] = (byte)i;
+			}
+		}
+	}
+
+	// On the DMG the sprite with the smaller X wins, and on equal X the one earlier in OAM.
+	// Insertion sort is stable, so the OAM order is kept on equal X
+	for (int line = 0; line < LCDHeight; line++)
+	{
+		Bucket& bucket = m_buckets[line];
+		std::memcpy(bucket.prioritySprites, bucket.sprites, bucket.count);
+		for (int i = 1; i < bucket.count; i++)
+		{
+			byte sprite = bucket.prioritySprites[i];
+			int j = i - 1;
+			for (; j >= 0 && sprites[bucket.prioritySprites[j]].x > sprites[sprite].x; j--)
+			{
+				bucket.prioritySprites[j + 1] = bucket.prioritySprites[j];
+			}
+
+			bucket.prioritySprites[j + 1] = sprite;
+		}
+	}
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "PCH.h"
+#include "PPURegisters.h"
+
+/**
+* The sprites of every visible line, found once per OAM change instead of by an OAM scan on every line.
+* The buckets are rebuilt on the first use after OAM was marked dirty or the sprite size changed.
+*/
+class SpriteBuckets
+{
+public:
+	/** The sprites of a line, at most MaxSpritesPerLine, as OAM indices */
+	struct Bucket
+	{
+		byte count;
+		byte sprites[MaxSpritesPerLine]; // In OAM order, like the OAM scan finds them
+		byte prioritySprites[MaxSpritesPerLine]; // The DMG drawing priority. Smaller X first, OAM order on equal X
+	};
+
+private:
+	const byte* m_oam;
+	bool* m_isOAMDirty;
+	int m_spriteHeight; // The height the buckets were built for. 0 before the first build
+
+	Bucket m_buckets[LCDHeight];
+	ulonglong m_rebuildCount;
+
+public:
+	/** oam points at the sprite attributes and isOAMDirty at the flag that is set when they change */
+	SpriteBuckets(const byte* oam, bool* isOAMDirty);
+
+	/** The sprites on line ly, for sprites spriteHeight (8 or 16) pixels high */
+	const Bucket& GetBucket(byte ly, int spriteHeight);
+
+	/** How many times the buckets were rebuilt */
+	ulonglong GetRebuildCount() const;
+
+private:
+	void Rebuild(int spriteHeight);
+};
@@ -0,0 +1,91 @@
+#include <cstdlib>
+#include <cstring>
+#include "StateArena.h"
+#include "Logger.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <stdlib.h>
+#endif
+
+StateArena::StateArena(size_t capacity) :
+	m_memory(nullptr),
+	m_capacity(0),
+	m_size(0)
+{
+	// Whole pages, so the block can be backed by large pages or mapped by itself
+	capacity = (capacity + PageSize - 1) & ~(PageSize - 1);
+
+#ifdef _WIN32
+	m_memory = static_cast<byte*>(VirtualAlloc(nullptr, capacity, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+#else
+	void* memory = nullptr;
+	if (posix_memalign(&memory, PageSize, capacity) == 0)
+	{
+		m_memory = static_cast<byte*>(memory);
+	}
+#endif
+
+	if (m_memory == nullptr)
+	{
+		// The subsystems can't run without their state
+		Logger::LogError("Could not allocate %u bytes for the state arena", (unsigned int)capacity);
+		std::abort();
+	}
+
+	m_capacity = capacity;
+	std::memset(m_memory, 0x00, m_capacity);
+}
+
+StateArena::~StateArena()
+{
+	if (m_memory != nullptr)
+	{
+#ifdef _WIN32
+		VirtualFree(m_memory, 0, MEM_RELEASE);
+#else
+		free(m_memory);
+#endif
+		m_memory = nullptr;
+	}
+}
+
+byte* StateArena::GetData()
+{
+	return m_memory;
+}
+
+const byte* StateArena::GetData() const
+{
+	return m_memory;
+}
+
+size_t StateArena::GetSize() const
+{
+	return m_size;
+}
+
+size_t StateArena::GetAllocationSize(size_t size)
+{
+	return (size + Alignment - 1) & ~(Alignment - 1);
+}
+
+void* StateArena::Allocate(size_t size)
+{
+	size_t allocationSize = GetAllocationSize(size);
+	if (m_size + allocationSize > m_capacity)
+	{
+		// The capacity is a fixed sum of the state sizes, so this is a state that is missing from the sum, not a runtime condition
+		Logger::LogError("The state arena is out of memory. Capacity: %u, requested: %u", (unsigned int)m_capacity, (unsigned int)(m_size + allocationSize));
+		std::abort();
+	}
+
+	// The memory is zeroed when the arena is created
+	void* memory = m_memory + m_size;
+	m_size += allocationSize;
+
+	return memory;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include "PCH.h"
+
+/**
+* One contiguous, page aligned block that holds the whole mutable state of a machine.
+* The subsystems allocate their state from it in a fixed order when they are constructed, so the layout is the same
+* for every instance. The state must not contain pointers, which makes a snapshot a single copy of the block.
+*/
+class StateArena
+{
+public:
+	static const size_t PageSize = 4096;
+	static const size_t Alignment = 64; // Every allocation starts on a cache line
+
+private:
+	byte* m_memory;
+	size_t m_capacity;
+	size_t m_size;
+
+public:
+	StateArena(size_t capacity);
+	~StateArena();
+
+	StateArena(const StateArena&) = delete;
+	StateArena& operator=(const StateArena&) = delete;
+
+	/** Allocate zeroed memory for a state struct. Aborts if the arena is full, so the result is never null */
+	template<typename T>
+	T* Allocate();
+
+	/** The beginning of the block */
+	byte* GetData();
+	const byte* GetData() const;
+
+	/** The bytes allocated so far. This is what a snapshot needs to copy */
+	size_t GetSize() const;
+
+	/** The size an allocation takes in the arena. Used to calculate the capacity */
+	static size_t GetAllocationSize(size_t size);
+
+private:
+	void* Allocate(size_t size);
+};
+
+template<typename T>
+T* StateArena::Allocate()
+{
+	return static_cast<T*>(Allocate(sizeof(T)));
+}
@@ -0,0 +1,123 @@
+#include <algorithm>
+#include "ThumbnailGrid.h"
+#include "CPUFeatures.h"
+#include "PPURegisters.h"
+#include "Scalers.h"
+#include "TripleBuffer.h"
+
+#if HAS_X86_SIMD
+#include <emmintrin.h>
+#endif
+
+ThumbnailGrid::ThumbnailGrid(const std::vector<TripleBuffer*>& sources, int columns, int shrinkShift) :
+	m_sources(sources),
+	m_columns(std::max(columns, 1)),
+	m_rows(((int)sources.size() + m_columns - 1) / m_columns),
+	m_shrinkShift(std::min(std::max(shrinkShift, 0), (int)MaxShrinkShift)), // By value, std::min would need a definition of the constant
+	m_tileWidth(LCDWidth >> m_shrinkShift),
+	m_tileHeight(LCDHeight >> m_shrinkShift),
+	m_width(m_tileWidth * m_columns),
+	m_height(m_tileHeight * std::max(m_rows, 1)),
+	m_canvas(std::make_unique<uint[]>(m_width * m_height)),
+	m_halfFrame(std::make_unique<uint[]>((LCDWidth / 2) * (LCDHeight / 2))),
+	m_updatedTileCount(0)
+{
+	std::fill_n(m_canvas.get(), m_width * m_height, 0xFF000000);
+}
+
+bool ThumbnailGrid::Update()
+{
+	bool isChanged = false;
+	for (int i = 0; i < (int)m_sources.size(); i++)
+	{
+		if (m_sources[i]->TakeNewest())
+		{
+			DrawTile(i, m_sources[i]->GetFrontBuffer());
+			isChanged = true;
+		}
+	}
+
+	return isChanged;
+}
+
+const uint* ThumbnailGrid::GetCanvas() const
+{
+	return m_canvas.get();
+}
+
+int ThumbnailGrid::GetWidth() const
+{
+	return m_width;
+}
+
+int ThumbnailGrid::GetHeight() const
+{
+	return m_height;
+}
+
+ulonglong ThumbnailGrid::GetUpdatedTileCount() const
+{
+	return m_updatedTileCount;
+}
+
+void ThumbnailGrid::DrawTile(int index, const uint* frame)
+{
+	uint* tile = m_canvas.get() + (index / m_columns) * m_tileHeight * m_width + (index % m_columns) * m_tileWidth;
+	switch (m_shrinkShift)
+	{
+	case 0:
+		for (int y = 0; y < LCDHeight; y++)
+		{
+			std::copy_n(frame + y * LCDWidth, LCDWidth, tile + y * m_width);
+		}
+		break;
+
+	case 1:
+		Halve(frame, LCDWidth, LCDHeight, LCDWidth, tile, m_width);
+		break;
+
+	default:
+		Halve(frame, LCDWidth, LCDHeight, LCDWidth, m_halfFrame.get(), LCDWidth / 2);
+		Halve(m_halfFrame.get(), LCDWidth / 2, LCDHeight / 2, LCDWidth / 2, tile, m_width);
+		break;
+	}
+
+	m_updatedTileCount++;
+}
+
+void ThumbnailGrid::Halve(const uint* source, int width, int height, int sourcePitch, uint* destination, int destinationPitch)
+{
+	for (int y = 0; y < height / 2; y++)
+	{
+		const uint* top = source + y * 2 * sourcePitch;
+		const uint* bottom = top + sourcePitch;
+		uint* output = destination + y * destinationPitch;
+		int x = 0;
+
+#if HAS_X86_SIMD
+		if (CPUFeatures::Get().hasSSE2)
+		{
+			// 8 source pixels into 4. The rows are averaged first, then the even and the odd columns
+			for (; x + 8 <= width; x += 8)
+			{
+				__m128i low = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(top + x)),
+					_mm_loadu_si128(reinterpret_cast<const __m128i*>(bottom + x)));
+				__m128i high = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(top + x + 4)),
+					_mm_loadu_si128(reinterpret_cast<const __m128i*>(bottom + x + 4)));
+
+				__m128 lowPixels = _mm_castsi128_ps(low);
+				__m128 highPixels = _mm_castsi128_ps(high);
+				__m128i even = _mm_castps_si128(_mm_shuffle_ps(lowPixels, highPixels, _MM_SHUFFLE(2, 0, 2, 0)));
+				__m128i odd = _mm_castps_si128(_mm_shuffle_ps(lowPixels, highPixels, _MM_SHUFFLE(3, 1, 3, 1)));
+
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(output + x / 2), _mm_avg_epu8(even, odd));
+			}
+		}
+#endif
+
+		for (; x < width; x += 2)
+		{
+			output[x / 2] = Scalers::Average(Scalers::Average(top[x], bottom[x]), Scalers::Average(top[x + 1], bottom[x + 1]));
+		}
+	}
+}
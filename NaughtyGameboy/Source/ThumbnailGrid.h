@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+#include "PCH.h"
+
+class TripleBuffer;
+
+/**
+* Composes the frames of many emulator instances into one picture, a grid of downscaled tiles, to watch them all in one window.
+* The newest frame of every instance is taken from its triple buffer, so the emulation threads never wait for the grid.
+* A tile is only downscaled again when its instance published a new frame.
+*/
+class ThumbnailGrid
+{
+public:
+	static const int MaxShrinkShift = 2; // Down to a quarter of the size in each direction
+
+private:
+	std::vector<TripleBuffer*> m_sources;
+	int m_columns;
+	int m_rows;
+	int m_shrinkShift; // The tiles are LCDWidth >> m_shrinkShift x LCDHeight >> m_shrinkShift
+	int m_tileWidth;
+	int m_tileHeight;
+	int m_width;
+	int m_height;
+
+	std::unique_ptr<uint[]> m_canvas;
+	std::unique_ptr<uint[]> m_halfFrame; // Scratch for the first halving, when the tiles are a quarter of the size
+
+	ulonglong m_updatedTileCount;
+
+public:
+	/** A grid of columns tiles per row, for the sources. shrinkShift halves the frames that many times, up to MaxShrinkShift */
+	ThumbnailGrid(const std::vector<TripleBuffer*>& sources, int columns, int shrinkShift);
+
+	ThumbnailGrid(const ThumbnailGrid&) = delete;
+	ThumbnailGrid& operator=(const ThumbnailGrid&) = delete;
+
+	/** Take the newest frame of every source and draw the new ones into their tiles. Returns whether any tile changed */
+	bool Update();
+
+	/** The grid, GetWidth() x GetHeight() ARGB8888 pixels. The space after the last tile is black */
+	const uint* GetCanvas() const;
+
+	int GetWidth() const;
+	int GetHeight() const;
+
+	/** The number of tiles that were drawn, for the statistics */
+	ulonglong GetUpdatedTileCount() const;
+
+	/**
+	* Halve a width x height ARGB8888 picture in both directions, averaging 2x2 blocks. The pitches are in pixels.
+	* width must be even. Uses SSE2 when the CPU has it, the result is the same either way
+	*/
+	static void Halve(const uint* source, int width, int height, int sourcePitch, uint* destination, int destinationPitch);
+
+private:
+	void DrawTile(int index, const uint* frame);
+};
@@ -0,0 +1,99 @@
+#include "TileCache.h"
+#include "BitUtil.h"
+#include "MMU.h"
+#include "PixelKernels.h"
+#include "PPURegisters.h"
+
+float TileCache::Stats::GetHitRate() const
+{
+	ulonglong fetches = hits + misses;
+	return (fetches > 0) ? (float)((double)hits / fetches) : 0.0f;
+}
+
+TileCache::TileCache(const byte* vram, uint* dirtyTiles, int bankCount, bool hasFlippedTiles) :
+	m_vram(vram),
+	m_dirtyTiles(dirtyTiles),
+	m_tileCount(bankCount * MMU::TilesPerBank),
+	m_kernels(&PixelKernels::GetBest()),
+	m_tiles(new DecodedTile[bankCount * MMU::TilesPerBank]),
+	m_flippedTiles(hasFlippedTiles ? new DecodedTile[bankCount * MMU::TilesPerBank] : nullptr)
+{
+	ResetStats();
+}
+
+const byte* TileCache::GetTileRow(int bank, int tile, int row, bool isFlipped)
+{
+	int index = bank * MMU::TilesPerBank + tile;
+
+	uint& dirtyBits = m_dirtyTiles[index / 32];
+	uint mask = 1u << (index % 32);
+	if ((dirtyBits & mask) != 0)
+	{
+		DecodeTile(index);
+		dirtyBits &= ~mask;
+		m_stats.misses++;
+	}
+	else
+	{
+		m_stats.hits++;
+	}
+
+	if (!isFlipped)
+	{
+		return m_tiles[index][row];
+	}
+
+	if (m_flippedTiles != nullptr)
+	{
+		return m_flippedTiles[index][row];
+	}
+
+	const byte* source = m_tiles[index][row];
+	for (int x = 0; x < TileWidth; x++)
+	{
+		m_flippedRow[x] = source[TileWidth - 1 - x];
+	}
+
+	return m_flippedRow;
+}
+
+int TileCache::GetBackgroundTile(byte lcdc, byte tileIndex)
+{
+	// Unsigned mode uses the tiles 0-255, signed mode -128-127 relative to tile 256
+	if (IS_BIT_SET(lcdc, LCDCBit::TileData))
+	{
+		return tileIndex;
+	}
+
+	return 256 + (sbyte)tileIndex;
+}
+
+const TileCache::Stats& TileCache::GetStats() const
+{
+	return m_stats;
+}
+
+void TileCache::ResetStats()
+{
+	m_stats.hits = 0;
+	m_stats.misses = 0;
+}
+
+void TileCache::DecodeTile(int index)
+{
+	const byte* data = m_vram + (index / MMU::TilesPerBank) * MMU::VRAMBankSize + (index % MMU::TilesPerBank) * MMU::TileSize;
+	DecodedTile& tile = m_tiles[index];
+	m_kernels->decodeTileRows(data, tile[0], TileHeight);
+
+	if (m_flippedTiles != nullptr)
+	{
+		DecodedTile& flipped = m_flippedTiles[index];
+		for (int y = 0; y < TileHeight; y++)
+		{
+			for (int x = 0; x < TileWidth; x++)
+			{
+				flipped[y][x] = tile[y][TileWidth - 1 - x];
+			}
+		}
+	}
+}
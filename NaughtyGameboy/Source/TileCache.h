@@ -0,0 +1,61 @@
+#pragma once
+
+#include "PCH.h"
+
+struct PixelKernels;
+
+/**
+* The VRAM tiles decoded to 1 byte color indices, so the renderers fetch a tile row with a plain 8 byte copy.
+* A tile is decoded again on its first use after the MMU marked it in the dirty bitmap.
+*/
+class TileCache
+{
+public:
+	static const int TileWidth = 8;
+	static const int TileHeight = 8;
+
+	struct Stats
+	{
+		ulonglong hits;
+		ulonglong misses; // Fetches that had to decode the tile first
+
+		float GetHitRate() const;
+	};
+
+private:
+	typedef byte DecodedTile[TileHeight][TileWidth];
+
+	const byte* m_vram; // Both banks, one after the other
+	uint* m_dirtyTiles;
+	int m_tileCount;
+	const PixelKernels* m_kernels;
+
+	std::unique_ptr<DecodedTile[]> m_tiles;
+	std::unique_ptr<DecodedTile[]> m_flippedTiles; // Horizontally flipped copies. Null if they are disabled
+
+	byte m_flippedRow[TileWidth]; // The flipped row, when there are no flipped copies
+
+	Stats m_stats;
+
+public:
+	/**
+	* vram points at bankCount banks of VRAM and dirtyTiles at their dirty bitmap, which is owned by the MMU.
+	* With hasFlippedTiles the flipped rows of the sprites are cached too, at the cost of twice the memory.
+	*/
+	TileCache(const byte* vram, uint* dirtyTiles, int bankCount, bool hasFlippedTiles);
+
+	/**
+	* The 8 color indices of a tile row. tile counts the tiles from the start of the bank (0-383).
+	* The returned row stays valid until the next fetch.
+	*/
+	const byte* GetTileRow(int bank, int tile, int row, bool isFlipped);
+
+	/** The tile index of a tile map entry, in the addressing mode selected by LCDC bit 4 */
+	static int GetBackgroundTile(byte lcdc, byte tileIndex);
+
+	const Stats& GetStats() const;
+	void ResetStats();
+
+private:
+	void DecodeTile(int index);
+};
@@ -0,0 +1,50 @@
+#include <algorithm>
+#include "TripleBuffer.h"
+
+TripleBuffer::TripleBuffer() :
+	m_frames(std::make_unique<uint[]>(FrameSize * 3)),
+	m_backIndex(0),
+	m_middleIndex(1),
+	m_frontIndex(2),
+	m_publishedCount(0)
+{
+	std::fill_n(m_frames.get(), FrameSize * 3, 0xFFFFFFFF);
+}
+
+uint* TripleBuffer::GetBackBuffer()
+{
+	return &m_frames[m_backIndex * FrameSize];
+}
+
+void TripleBuffer::Publish()
+{
+	// The release makes the drawing of the frame visible to the consumer that takes it
+	int previous = m_middleIndex.exchange(m_backIndex | FreshFlag, std::memory_order_acq_rel);
+	m_backIndex = previous & IndexMask;
+
+	m_publishedCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool TripleBuffer::TakeNewest()
+{
+	if ((m_middleIndex.load(std::memory_order_relaxed) & FreshFlag) == 0)
+	{
+		return false;
+	}
+
+	// The acquire pairs with the release of Publish. The frame given back loses the flag, so it's never taken twice
+	int previous = m_middleIndex.exchange(m_frontIndex, std::memory_order_acq_rel);
+	m_frontIndex = previous & IndexMask;
+
+	return true;
+}
+
+const uint* TripleBuffer::GetFrontBuffer() const
+{
+	return &m_frames[m_frontIndex * FrameSize];
+}
+
+ulonglong TripleBuffer::GetPublishedCount() const
+{
+	return m_publishedCount.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include "PCH.h"
+#include "PPURegisters.h"
+
+/**
+* Passes whole frames from one producer thread to one consumer thread, without a lock and without either side ever waiting.
+* There are three frames: the producer draws into the back one, the consumer reads the front one, and the middle one
+* holds the newest published frame. Publishing and taking are single atomic exchanges of the middle index,
+* so the consumer always gets the newest complete frame and never one that is still being drawn.
+*/
+class TripleBuffer
+{
+public:
+	static const int FrameSize = LCDWidth * LCDHeight;
+
+private:
+	static const int FreshFlag = 4; // Set in the middle index when it holds a frame the consumer hasn't taken yet
+	static const int IndexMask = 3;
+
+	std::unique_ptr<uint[]> m_frames; // 3 ARGB8888 frames
+
+	int m_backIndex; // Producer only
+	std::atomic<int> m_middleIndex;
+	int m_frontIndex; // Consumer only
+
+	std::atomic<ulonglong> m_publishedCount;
+
+public:
+	TripleBuffer();
+
+	TripleBuffer(const TripleBuffer&) = delete;
+	TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+	/** Producer only. The frame to draw the next frame into */
+	uint* GetBackBuffer();
+
+	/** Producer only. Publish the back buffer as the newest frame. The producer gets another back buffer */
+	void Publish();
+
+	/** Consumer only. Take the newest frame if there is one that wasn't taken yet. Returns whether the front buffer changed */
+	bool TakeNewest();
+
+	/** Consumer only. The last frame that was taken. White until the first one */
+	const uint* GetFrontBuffer() const;
+
+	/** The number of frames that were published. Can be read from any thread */
+	ulonglong GetPublishedCount() const;
+};
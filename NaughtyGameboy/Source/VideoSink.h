@@ -0,0 +1,13 @@
+#pragma once
+
+#include "PCH.h"
+
+/** Where the emulated frames go. The SDL window is one implementation, the headless sink another */
+class VideoSink
+{
+public:
+	virtual ~VideoSink() {}
+
+	/** Called once per emulated frame with the LCDWidth x LCDHeight ARGB8888 framebuffer */
+	virtual void Present(const uint* framebuffer) = 0;
+};